@@ -0,0 +1,130 @@
+/*
+  Benchmark for the remote cache policies
+  Replays remote node access streams against every policy at several cache sizes,
+  reports hit rate, ns per access and the peak heap used by the cache
+  Streams are either synthetic
+    global : GlobalNode style, half the accesses are uniform over all nodes (one-hit wonders)
+             and half follow a zipf distribution like the neighbors reached by sampling
+    zipf   : GraphSage style, all accesses follow the zipf distribution
+  or recorded by graph servers started with GRAPHMIX_CACHE_TRACE=<path>, see common/trace.h
+  Cache sizes are given as a ratio of the distinct nodes in the stream
+  usage : cache_bench [num_nodes=1000000] [num_access=4000000]
+          cache_bench --trace <path>...
+*/
+#include "common/cache.h"
+#include "common/trace.h"
+
+#include <malloc.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <new>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+// count live heap bytes, so that the peak of one replay can be measured
+static std::atomic<size_t> heap_live{0}, heap_peak{0};
+
+void* operator new(size_t size) {
+  void *ptr = malloc(size ? size : 1);
+  if (!ptr) throw std::bad_alloc();
+  size_t live = heap_live += malloc_usable_size(ptr);
+  size_t peak = heap_peak.load();
+  while (live > peak && !heap_peak.compare_exchange_weak(peak, live));
+  return ptr;
+}
+void operator delete(void *ptr) noexcept {
+  if (!ptr) return;
+  heap_live -= malloc_usable_size(ptr);
+  free(ptr);
+}
+void operator delete(void *ptr, size_t) noexcept { operator delete(ptr); }
+
+typedef int64_t node_id;
+typedef cache::Cache<node_id, int> Cache;
+
+std::unique_ptr<Cache> makeCache(const std::string &name, size_t limit) {
+  if (name == "LRU") return std::make_unique<cache::LRUCache<node_id, int>>(limit);
+  if (name == "LFU") return std::make_unique<cache::LFUCache<node_id, int>>(limit);
+  if (name == "LFUOpt") return std::make_unique<cache::LFUOptCache<node_id, int>>(limit);
+  return std::make_unique<cache::TinyLFUCache<node_id, int>>(limit);
+}
+
+std::vector<node_id> makeTrace(size_t num_nodes, size_t num_access, double uniform_ratio) {
+  std::mt19937_64 rd(0);
+  // zipf with exponent 0.9 over a random permutation of the nodes
+  std::vector<double> cdf(num_nodes);
+  double sum = 0;
+  for (size_t i = 0; i < num_nodes; i++) cdf[i] = sum += 1.0 / std::pow(i + 1, 0.9);
+  std::vector<node_id> perm(num_nodes);
+  for (size_t i = 0; i < num_nodes; i++) perm[i] = i;
+  std::shuffle(perm.begin(), perm.end(), rd);
+  std::uniform_real_distribution<double> real(0, 1);
+  std::uniform_int_distribution<node_id> uniform(0, num_nodes - 1);
+  std::vector<node_id> trace(num_access);
+  for (auto &node : trace) {
+    if (real(rd) < uniform_ratio) node = uniform(rd);
+    else node = perm[std::lower_bound(cdf.begin(), cdf.end(), real(rd) * sum) - cdf.begin()];
+  }
+  return trace;
+}
+
+struct Result {
+  double hit_rate, ns_per_op;
+  size_t peak_bytes;
+};
+
+// filterNode looks a node up and the fetched node is inserted on miss
+Result replay(const std::string &name, size_t limit, const std::vector<node_id> &trace) {
+  size_t base = heap_live;
+  heap_peak = base;
+  auto start = std::chrono::steady_clock::now();
+  auto cache = makeCache(name, limit);
+  for (node_id node : trace) {
+    int data = -1;
+    cache->lookup(node, data);
+    if (data < 0) cache->insert(node, 0);
+  }
+  auto end = std::chrono::steady_clock::now();
+  cache::Stats stats = cache->stats();
+  Result result;
+  result.hit_rate = double(stats.hits) / std::max<size_t>(stats.hits + stats.misses, 1);
+  result.ns_per_op = std::chrono::duration<double, std::nano>(end - start).count() / std::max<size_t>(trace.size(), 1);
+  result.peak_bytes = heap_peak - base;
+  return result;
+}
+
+void run(const std::string &title, const std::vector<node_id> &trace) {
+  std::vector<std::string> policies = {"LRU", "LFU", "LFUOpt", "TinyLFU"};
+  size_t distinct = std::unordered_set<node_id>(trace.begin(), trace.end()).size();
+  printf("trace %s : %zu accesses, %zu distinct nodes\n", title.c_str(), trace.size(), distinct);
+  printf("%8s %9s %10s %10s %10s\n", "size", "policy", "hit rate", "ns/op", "peak MB");
+  for (double ratio : {0.01, 0.05, 0.1, 0.2}) {
+    size_t limit = std::max<size_t>(distinct * ratio, 1);
+    for (auto &name : policies) {
+      Result result = replay(name, limit, trace);
+      printf("%7.0f%% %9s %10.3f %10.1f %10.2f\n", ratio * 100, name.c_str(),
+        result.hit_rate, result.ns_per_op, result.peak_bytes / 1048576.0);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  if (argc > 1 && strcmp(argv[1], "--trace") == 0) {
+    for (int i = 2; i < argc; i++) run(argv[i], cache::readTrace(argv[i]));
+    return 0;
+  }
+  size_t num_nodes = argc > 1 ? atol(argv[1]) : 1000000;
+  size_t num_access = argc > 2 ? atol(argv[2]) : 4000000;
+  run("global", makeTrace(num_nodes, num_access, 0.5));
+  run("zipf", makeTrace(num_nodes, num_access, 0));
+  return 0;
+}
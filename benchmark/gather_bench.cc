@@ -0,0 +1,79 @@
+/*
+  Micro benchmark for the feature gather kernel
+  Compare the per-node std::copy loop used in minibatch construction with gather::gatherRows
+  usage : gather_bench [num_rows=100000] [feature_len=602]
+*/
+#include "common/gather.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <functional>
+#include <random>
+#include <vector>
+
+typedef float graph_float;
+
+double timeit(const std::function<void()> &func, int repeat) {
+  func(); // warm up
+  auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < repeat; i++) func();
+  auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double>(end - start).count() / repeat;
+}
+
+int main(int argc, char **argv) {
+  size_t num_rows = argc > 1 ? atol(argv[1]) : 100000;
+  size_t f_len = argc > 2 ? atol(argv[2]) : 602;
+  std::vector<graph_float> source(num_rows * f_len);
+  std::mt19937_64 rd(0);
+  for (auto &x : source) x = rd() % 1000;
+
+  printf("rows=%zu feature_len=%zu best_isa=%d\n", num_rows, f_len, int(gather::bestIsa()));
+  printf("%8s %-16s %10s %10s\n", "batch", "method", "ns/row", "GB/s");
+  for (size_t batch : {1024, 8192, 65536}) {
+    batch = std::min(batch, num_rows);
+    std::vector<const void*> rows(batch);
+    for (size_t i = 0; i < batch; i++) rows[i] = &source[(rd() % num_rows) * f_len];
+    std::vector<graph_float> out(batch * f_len), expect(batch * f_len);
+    int repeat = std::max<int>(1, (1 << 24) / (batch * f_len));
+
+    auto report = [&](const char *name, double sec) {
+      double bytes = double(batch) * f_len * sizeof(graph_float);
+      printf("%8zu %-16s %10.1f %10.2f\n", batch, name, sec * 1e9 / batch, bytes / sec / 1e9);
+    };
+    // the loop used by BaseSampler::construct before the kernel
+    report("copy_loop", timeit([&]() {
+      for (size_t i = 0; i < batch; i++) {
+        auto src = static_cast<const graph_float*>(rows[i]);
+        std::copy(src, src + f_len, &expect[i * f_len]);
+      }
+    }, repeat));
+
+    struct Case { const char *name; gather::isa level; bool stream; };
+    std::vector<Case> cases = { {"scalar", gather::isa::scalar, false} };
+    if (gather::bestIsa() >= gather::isa::avx2) {
+      cases.push_back({"avx2", gather::isa::avx2, false});
+      cases.push_back({"avx2_stream", gather::isa::avx2, true});
+    }
+    if (gather::bestIsa() >= gather::isa::avx512) {
+      cases.push_back({"avx512", gather::isa::avx512, false});
+      cases.push_back({"avx512_stream", gather::isa::avx512, true});
+    }
+    for (auto &c : cases) {
+      report(c.name, timeit([&]() {
+        gather::gatherRows(rows.data(), batch, f_len * sizeof(graph_float), out.data(), c.level, c.stream);
+      }, repeat));
+      if (out != expect) printf("%s result mismatch\n", c.name);
+    }
+    for (size_t nthread : {2, 4}) {
+      std::string name = "auto_thread" + std::to_string(nthread);
+      report(name.c_str(), timeit([&]() {
+        gather::gatherRows(rows.data(), batch, f_len * sizeof(graph_float), out.data(), nthread);
+      }, repeat));
+      if (out != expect) printf("%s result mismatch\n", name.c_str());
+    }
+  }
+  return 0;
+}
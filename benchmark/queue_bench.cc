@@ -0,0 +1,71 @@
+/*
+  Contention benchmark for the server minibatch queue
+  Compare ThreadsafeBoundedQueue with MPMCBoundedQueue, producers play samplers and consumers play receive threads
+  usage : queue_bench [items_per_producer=200000] [limit=32]
+*/
+#include "common/bounded_queue.h"
+#include "common/mpmc_queue.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <thread>
+#include <vector>
+
+// a minibatch holds several shared arrays, moving it costs a few pointer copies
+struct Payload {
+  std::shared_ptr<int> f_feat, i_feat, csr_i, csr_j;
+  long id = 0;
+};
+
+template <typename Queue>
+double run(size_t nproducer, size_t nconsumer, size_t items, size_t limit) {
+  Queue queue(limit);
+  auto shared = std::make_shared<int>(0);
+  size_t total = nproducer * items;
+  std::vector<std::thread> threads;
+  std::vector<long> sums(nconsumer);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t p = 0; p < nproducer; p++) {
+    threads.emplace_back([&, p]() {
+      for (size_t i = 0; i < items; i++) {
+        Payload item;
+        item.f_feat = item.i_feat = item.csr_i = item.csr_j = shared;
+        item.id = 1;
+        queue.Push(std::move(item));
+      }
+    });
+  }
+  for (size_t c = 0; c < nconsumer; c++) {
+    // consumers split the items evenly, the first one takes the remainder
+    size_t count = total / nconsumer + (c == 0 ? total % nconsumer : 0);
+    threads.emplace_back([&, c, count]() {
+      Payload item;
+      for (size_t i = 0; i < count; i++) {
+        // serve(GraphPull) tries first and waits only when empty
+        if (!queue.TryPop(&item)) queue.WaitAndPop(&item);
+        sums[c] += item.id;
+      }
+    });
+  }
+  for (auto &t : threads) t.join();
+  auto end = std::chrono::steady_clock::now();
+  long sum = 0;
+  for (long s : sums) sum += s;
+  if (size_t(sum) != total) printf("lost items %ld/%zu\n", sum, total);
+  return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char **argv) {
+  size_t items = argc > 1 ? atol(argv[1]) : 200000;
+  size_t limit = argc > 2 ? atol(argv[2]) : 32;
+  printf("%9s %9s %14s %14s\n", "producer", "consumer", "mutex Mop/s", "mpmc Mop/s");
+  for (auto config : std::vector<std::pair<size_t, size_t>>{{1, 1}, {4, 4}, {8, 2}, {32, 10}}) {
+    size_t total = config.first * items;
+    double t1 = run<ThreadsafeBoundedQueue<Payload>>(config.first, config.second, items, limit);
+    double t2 = run<MPMCBoundedQueue<Payload>>(config.first, config.second, items, limit);
+    printf("%9zu %9zu %14.2f %14.2f\n", config.first, config.second, total / t1 / 1e6, total / t2 / 1e6);
+  }
+  return 0;
+}
@@ -0,0 +1,91 @@
+/*
+  Micro benchmark for minibatch reindexing
+  Compare the std::unordered_map built per batch, as construct used to do, with the generation tagged
+  Reindexer reused across batches. Batches change in size and keys, every result is checked against
+  the map, including that keys of the previous batch are gone after reset
+  usage : reindex_bench [num_nodes=20000] [num_probes=500000] [num_batches=50]
+*/
+#include "graph/reindex.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+struct Batch {
+  std::vector<node_id> nodes, probes;
+};
+
+// distinct nodes drawn from a large id space, probes hit a node of the batch half of the time
+Batch makeBatch(size_t num_nodes, size_t num_probes, std::mt19937_64 &rd) {
+  std::uniform_int_distribution<node_id> id(0, 1L << 40);
+  Batch batch;
+  std::unordered_map<node_id, int> seen;
+  while (batch.nodes.size() < num_nodes) {
+    node_id node = id(rd);
+    if (seen.emplace(node, 0).second) batch.nodes.push_back(node);
+  }
+  std::uniform_int_distribution<size_t> pick(0, num_nodes - 1);
+  for (size_t i = 0; i < num_probes; i++)
+    batch.probes.push_back(rd() & 1 ? batch.nodes[pick(rd)] : id(rd));
+  return batch;
+}
+
+int main(int argc, char **argv) {
+  size_t num_nodes = argc > 1 ? atol(argv[1]) : 20000;
+  size_t num_probes = argc > 2 ? atol(argv[2]) : 500000;
+  size_t num_batches = argc > 3 ? atol(argv[3]) : 50;
+  std::mt19937_64 rd(0);
+  std::vector<Batch> batches;
+  for (size_t i = 0; i < num_batches; i++) {
+    // sizes vary, so that reset both reuses and grows the table
+    size_t n = num_nodes / 4 + rd() % num_nodes;
+    batches.push_back(makeBatch(n, num_probes, rd));
+  }
+
+  std::vector<std::vector<node_id>> expect(num_batches);
+  auto start = std::chrono::steady_clock::now();
+  for (size_t b = 0; b < num_batches; b++) {
+    std::unordered_map<node_id, node_id> map;
+    for (node_id node : batches[b].nodes) map.emplace(node, map.size());
+    auto &result = expect[b];
+    result.clear();
+    for (node_id node : batches[b].probes) result.push_back(map.count(node) ? map[node] : -1);
+  }
+  double map_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  ps::Reindexer reindex;
+  std::vector<node_id> result;
+  size_t mismatch = 0;
+  start = std::chrono::steady_clock::now();
+  for (size_t b = 0; b < num_batches; b++) {
+    reindex.reset(batches[b].nodes.size());
+    for (node_id node : batches[b].nodes) reindex.insert(node);
+    result.clear();
+    for (node_id node : batches[b].probes) result.push_back(reindex.find(node));
+    if (result != expect[b] || reindex.size() != batches[b].nodes.size()) mismatch++;
+  }
+  double reindex_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+  // keys of the previous generation must not be found, unless the new batch has them too
+  size_t stale = 0;
+  for (size_t b = 0; b + 1 < num_batches; b++) {
+    reindex.reset(batches[b + 1].nodes.size());
+    for (node_id node : batches[b + 1].nodes) reindex.insert(node);
+    for (node_id node : batches[b].nodes) {
+      node_id idx = reindex.find(node);
+      if (idx >= 0 && batches[b + 1].nodes[idx] != node) stale++;
+    }
+  }
+
+  printf("%zu batches, ~%zu nodes and %zu probes each\n", num_batches, num_nodes, num_probes);
+  printf("%14s %10.2f ms/batch\n", "unordered_map", map_ms / num_batches);
+  printf("%14s %10.2f ms/batch\n", "Reindexer", reindex_ms / num_batches);
+  if (mismatch || stale) {
+    printf("FAILED : %zu batches differ from the map, %zu stale keys\n", mismatch, stale);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,178 @@
+/*
+  Loopback benchmark for the transports of the ps vans
+  A sender thread sends messages made of a 64 byte meta and one data frame to a receiver thread
+  over 127.0.0.1, once through ZMQ DEALER -> ROUTER with the framing of ZMQVan and once through
+  the io_uring transport of UringVan, reports messages/s and MB/s at several frame sizes
+  Then one process sends to several receivers from as many threads, with one lock over all sends as
+  ZMQVan used to take and with one lock per destination as it does now, reports MB/s by receiver count
+  usage : van_bench [port=23456] [total_mb=1024]
+*/
+#include <zmq.h>
+#include "../graphmix/src/uring_transport.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+static const int kMetaSize = 64;
+
+static void freeSArray(void *data, void *hint) {
+  delete static_cast<SArray<char>*>(hint);
+}
+
+static void freeMeta(void *data, void *hint) {
+  delete[] static_cast<char*>(data);
+}
+
+// same frames as ZMQVan : identity, meta, data. the data frame is sent without a copy
+double runZMQ(int port, const SArray<char> &frame, size_t count) {
+  void *context = zmq_ctx_new();
+  void *router = zmq_socket(context, ZMQ_ROUTER);
+  std::string addr = "tcp://127.0.0.1:" + std::to_string(port);
+  CHECK_EQ(zmq_bind(router, addr.c_str()), 0) << zmq_strerror(errno);
+  auto start = std::chrono::steady_clock::now();
+  std::thread sender([&]() {
+    void *dealer = zmq_socket(context, ZMQ_DEALER);
+    zmq_setsockopt(dealer, ZMQ_IDENTITY, "ps9", 3);
+    CHECK_EQ(zmq_connect(dealer, addr.c_str()), 0);
+    for (size_t i = 0; i < count; i++) {
+      zmq_msg_t meta_msg, data_msg;
+      zmq_msg_init_data(&meta_msg, new char[kMetaSize](), kMetaSize, freeMeta, NULL);
+      zmq_msg_send(&meta_msg, dealer, ZMQ_SNDMORE);
+      SArray<char> *data = new SArray<char>(frame);
+      zmq_msg_init_data(&data_msg, data->data(), data->size(), freeSArray, data);
+      zmq_msg_send(&data_msg, dealer, 0);
+    }
+    int linger = -1;
+    zmq_setsockopt(dealer, ZMQ_LINGER, &linger, sizeof(linger));
+    zmq_close(dealer);
+  });
+  for (size_t i = 0; i < count; i++) {
+    for (int part = 0; part < 3; part++) {
+      zmq_msg_t msg;
+      zmq_msg_init(&msg);
+      CHECK_NE(zmq_msg_recv(&msg, router, 0), -1);
+      zmq_msg_close(&msg);
+    }
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  sender.join();
+  zmq_close(router);
+  zmq_ctx_destroy(context);
+  return seconds;
+}
+
+// npeer sending threads, message i of thread t goes to receiver (t + i) % npeer
+double runZMQPeers(int port, const SArray<char> &frame, size_t count, int npeer, bool per_peer_lock) {
+  void *recv_context = zmq_ctx_new(), *send_context = zmq_ctx_new();
+  zmq_ctx_set(recv_context, ZMQ_IO_THREADS, npeer);
+  zmq_ctx_set(send_context, ZMQ_IO_THREADS, npeer);
+  std::vector<std::string> addrs;
+  std::vector<void*> routers, dealers;
+  for (int k = 0; k < npeer; k++) {
+    addrs.push_back("tcp://127.0.0.1:" + std::to_string(port + k));
+    routers.push_back(zmq_socket(recv_context, ZMQ_ROUTER));
+    CHECK_EQ(zmq_bind(routers[k], addrs[k].c_str()), 0) << zmq_strerror(errno);
+    dealers.push_back(zmq_socket(send_context, ZMQ_DEALER));
+    zmq_setsockopt(dealers[k], ZMQ_IDENTITY, "ps9", 3);
+    CHECK_EQ(zmq_connect(dealers[k], addrs[k].c_str()), 0);
+  }
+  std::mutex global_mu;
+  std::vector<std::unique_ptr<std::mutex>> peer_mu;
+  for (int k = 0; k < npeer; k++) peer_mu.emplace_back(new std::mutex());
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (int k = 0; k < npeer; k++) {
+    threads.emplace_back([&, k]() {
+      for (size_t i = 0; i < count * 3; i++) {
+        zmq_msg_t msg;
+        zmq_msg_init(&msg);
+        CHECK_NE(zmq_msg_recv(&msg, routers[k], 0), -1);
+        zmq_msg_close(&msg);
+      }
+    });
+  }
+  for (int t = 0; t < npeer; t++) {
+    threads.emplace_back([&, t]() {
+      for (size_t i = 0; i < count; i++) {
+        int k = (t + i) % npeer;
+        std::lock_guard<std::mutex> lk(per_peer_lock ? *peer_mu[k] : global_mu);
+        zmq_msg_t meta_msg, data_msg;
+        zmq_msg_init_data(&meta_msg, new char[kMetaSize](), kMetaSize, freeMeta, NULL);
+        zmq_msg_send(&meta_msg, dealers[k], ZMQ_SNDMORE);
+        SArray<char> *data = new SArray<char>(frame);
+        zmq_msg_init_data(&data_msg, data->data(), data->size(), freeSArray, data);
+        zmq_msg_send(&data_msg, dealers[k], 0);
+      }
+    });
+  }
+  for (auto &thread : threads) thread.join();
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  for (int k = 0; k < npeer; k++) {
+    int linger = 0;
+    zmq_setsockopt(dealers[k], ZMQ_LINGER, &linger, sizeof(linger));
+    zmq_close(dealers[k]);
+    zmq_close(routers[k]);
+  }
+  zmq_ctx_destroy(send_context);
+  zmq_ctx_destroy(recv_context);
+  return seconds;
+}
+
+double runUring(int port, const SArray<char> &frame, size_t count) {
+  int listen_fd = ps::listenTcp(port);
+  CHECK_NE(listen_fd, -1) << "port " << port << " is taken";
+  ps::UringReceiver receiver(listen_fd);
+  auto start = std::chrono::steady_clock::now();
+  std::thread sender([&]() {
+    int fd = ps::connectTcp("127.0.0.1", port);
+    CHECK_NE(fd, -1);
+    const char *zc_bytes = getenv("GRAPHMIX_URING_ZC_BYTES");
+    ps::UringSender channel(fd, 9, zc_bytes ? atol(zc_bytes) : 32768);
+    std::vector<SArray<char>> data = {frame};
+    char meta[kMetaSize] = {};
+    for (size_t i = 0; i < count; i++) channel.send(meta, kMetaSize, data);
+  });
+  for (size_t i = 0; i < count; i++) {
+    ps::UringMessage msg;
+    receiver.recv(&msg);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  sender.join();
+  return seconds;
+}
+
+int main(int argc, char **argv) {
+  int port = argc > 1 ? atoi(argv[1]) : 23456;
+  size_t total = (argc > 2 ? atol(argv[2]) : 1024) << 20;
+  printf("%10s %6s %10s %12s %10s\n", "frame", "van", "messages", "messages/s", "MB/s");
+  for (size_t size : {64, 1024, 16384, 262144, 4194304}) {
+    SArray<char> frame(size, 1);
+    size_t count = std::min<size_t>(std::max<size_t>(total / (size + kMetaSize), 100), 200000);
+    double zmq_seconds = runZMQ(port, frame, count);
+    double uring_seconds = runUring(port + 1, frame, count);
+    for (auto run : {std::make_pair("zmq", zmq_seconds), std::make_pair("uring", uring_seconds)}) {
+      printf("%10zu %6s %10zu %12.0f %10.1f\n", size, run.first, count,
+        count / run.second, count * (size + kMetaSize) / run.second / 1048576);
+    }
+  }
+  printf("\n%10s %6s %12s %12s\n", "frame", "peers", "global MB/s", "per-peer MB/s");
+  for (size_t size : {1024, 262144}) {
+    SArray<char> frame(size, 1);
+    for (int npeer : {1, 2, 4, 8}) {
+      // each receiver gets the same bytes as a single one above
+      size_t count = std::min<size_t>(std::max<size_t>(total / 4 / (size + kMetaSize), 100), 200000);
+      double global = runZMQPeers(port + 10, frame, count, npeer, false);
+      double per_peer = runZMQPeers(port + 20, frame, count, npeer, true);
+      double bytes = double(count) * npeer * (size + kMetaSize) / 1048576;
+      printf("%10zu %6d %12.1f %12.1f\n", size, npeer, bytes / global, bytes / per_peer);
+    }
+  }
+  return 0;
+}
@@ -0,0 +1,16 @@
+# - Try to find liburing
+# Once done this will define
+# URING_FOUND - System has liburing
+# URING_INCLUDE_DIRS - The liburing include directories
+# URING_LIBRARIES - The libraries needed to use liburing
+
+find_path ( URING_INCLUDE_DIR liburing.h )
+find_library ( URING_LIBRARY NAMES uring )
+
+set ( URING_LIBRARIES ${URING_LIBRARY} )
+set ( URING_INCLUDE_DIRS ${URING_INCLUDE_DIR} )
+
+include ( FindPackageHandleStandardArgs )
+# handle the QUIETLY and REQUIRED arguments and set URING_FOUND to TRUE
+# if all listed variables are TRUE
+find_package_handle_standard_args ( URING DEFAULT_MSG URING_LIBRARY URING_INCLUDE_DIR )
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <vector>
+
+/*
+  Arena:
+    Monotonic buffer, deallocation is a no-op and all memory is released at once by reset()
+    Blocks are kept after reset(), so a recycled arena stops calling malloc once warmed up
+    Not thread safe
+*/
+class Arena {
+public:
+  explicit Arena(size_t block_size = 1 << 16) : block_size_(block_size) {}
+  Arena(const Arena&) = delete;
+  Arena& operator=(const Arena&) = delete;
+
+  void* allocate(size_t bytes, size_t align) {
+    while (true) {
+      if (cur_ < blocks_.size()) {
+        size_t pos = (pos_ + align - 1) & ~(align - 1);
+        if (pos + bytes <= blocks_[cur_].size) {
+          pos_ = pos + bytes;
+          return blocks_[cur_].data.get() + pos;
+        }
+        cur_++;
+        pos_ = 0;
+        continue;
+      }
+      size_t size = blocks_.empty() ? block_size_ : blocks_.back().size * 2;
+      blocks_.push_back(Block(std::max(size, bytes + align)));
+    }
+  }
+  // all memory returned by allocate() becomes invalid
+  void reset() {
+    cur_ = 0;
+    pos_ = 0;
+  }
+  size_t capacity() const {
+    size_t result = 0;
+    for (auto &block : blocks_) result += block.size;
+    return result;
+  }
+private:
+  struct Block {
+    explicit Block(size_t size) : data(new char[size]), size(size) {}
+    std::unique_ptr<char[]> data;
+    size_t size;
+  };
+  std::vector<Block> blocks_;
+  size_t cur_ = 0, pos_ = 0;
+  const size_t block_size_;
+};
+
+/*
+  ArenaAllocator:
+    STL allocator on an Arena, falls back to the global heap when no arena is given
+    so containers using it can still be default constructed
+*/
+template <typename T>
+class ArenaAllocator {
+public:
+  typedef T value_type;
+  typedef std::true_type propagate_on_container_move_assignment;
+  typedef std::true_type propagate_on_container_swap;
+
+  ArenaAllocator() noexcept {}
+  explicit ArenaAllocator(Arena *arena) noexcept : arena_(arena) {}
+  template <typename U>
+  ArenaAllocator(const ArenaAllocator<U> &other) noexcept : arena_(other.arena()) {}
+
+  T* allocate(size_t n) {
+    if (!arena_) return static_cast<T*>(::operator new(n * sizeof(T)));
+    return static_cast<T*>(arena_->allocate(n * sizeof(T), alignof(T)));
+  }
+  void deallocate(T *ptr, size_t) noexcept {
+    if (!arena_) ::operator delete(ptr);
+  }
+  Arena* arena() const noexcept { return arena_; }
+private:
+  Arena *arena_ = nullptr;
+};
+
+template <typename T, typename U>
+bool operator==(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena() == b.arena(); }
+
+template <typename T, typename U>
+bool operator!=(const ArenaAllocator<T> &a, const ArenaAllocator<U> &b) { return a.arena() != b.arena(); }
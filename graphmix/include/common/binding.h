@@ -57,6 +57,22 @@ std::vector<T> a2v(py::array_t<T> &arr) {
   return v;
 }
 
+// snippet for converting python array to SArray (but without copy)
+// the python array is kept alive until the SArray is released
+template <typename T>
+SArray<T> a2s_nocp(py::array_t<T> &arr) {
+  auto holder = new py::array_t<T>(arr);
+  SArray<T> result;
+  result.reset(const_cast<T*>(arr.data()), arr.size(), [holder](T*) {
+    // python objects can only be released with GIL, skip it on interpreter exit
+    if (Py_IsInitialized()) {
+      py::gil_scoped_acquire acquire;
+      delete holder;
+    }
+  });
+  return result;
+}
+
 } // namespace bind
 
 // Check an array is continuous is C
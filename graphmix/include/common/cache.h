@@ -1,8 +1,15 @@
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
+#include <atomic>
+#include <functional>
+#include <memory>
 #include <mutex>
+#include <stdexcept>
 #include <list>
 #include <unordered_map>
+#include <vector>
 
 namespace cache {
 
@@ -10,34 +17,225 @@ enum class policy {
   LRU,
   LFU,
   LFUOpt,
+  Static,
+  TinyLFU,
+};
+
+// counters reported by every cache
+struct Stats {
+  size_t bytes = 0; // total charge of resident entries
+  size_t entries = 0;
+  size_t hits = 0, misses = 0, evictions = 0;
+  size_t rejections = 0; // inserts dropped because the entry alone exceeds the limit
 };
 
 /*
   Cache:
     Cache is the Base class of all cache Policy
     args:
-      limit: the number of Data will not exceed limit
+      limit: the total charge of Data will not exceed limit
+      charge: the cost of one Data, every Data costs 1 if not given, so limit is an entry count
     Note : Cache operations(insert, lookup, count, size) are not thread-safe.
     Note : Data must be copyable and movable. (you might use shared_ptr)
 */
 template <typename cache_key_t, class Data>
 class Cache {
+public:
+  typedef std::function<size_t(const Data&)> Charge;
+  // entries rejected by accept count as misses and are neither returned nor promoted
+  typedef std::function<bool(const Data&)> Accept;
 protected:
   size_t limit_;
+  Charge charge_;
+  Stats stats_;
+  size_t charge(const Data &data) { return charge_ ? charge_(data) : 1; }
 public:
   /*
     limit: cache size limit
   */
-  explicit Cache(size_t limit) : limit_(limit) {}
+  explicit Cache(size_t limit, Charge charge = nullptr) : limit_(limit), charge_(charge) {}
   virtual ~Cache() {}
   size_t getLimit() { return limit_; }
+  virtual Stats stats() {
+    Stats result = stats_;
+    result.entries = size();
+    return result;
+  }
   //------------------------- cache policy virtual function ---------------------
   virtual size_t size() = 0;
   virtual int count(cache_key_t k) = 0;
   virtual void insert(cache_key_t, const Data &data) = 0;
-  virtual void lookup(cache_key_t k, Data &data) = 0;
+  virtual void lookup(cache_key_t k, Data &data, const Accept &accept = nullptr) = 0;
+  //------------------------- batch operations ----------------------------------
+  // default to one call per key, thread-safe caches override these to lock once per batch
+  virtual void insert(const cache_key_t *keys, const Data *data, size_t n) {
+    for (size_t i = 0; i < n; i++) insert(keys[i], data[i]);
+  }
+  virtual void lookup(const cache_key_t *keys, Data *data, size_t n, const Accept &accept = nullptr) {
+    for (size_t i = 0; i < n; i++) lookup(keys[i], data[i], accept);
+  }
+  // insert only the keys not cached yet, so that partial data never replaces a fuller entry
+  virtual void insertMissing(const cache_key_t *keys, const Data *data, size_t n) {
+    for (size_t i = 0; i < n; i++)
+      if (!count(keys[i])) insert(keys[i], data[i]);
+  }
 }; // class Cache
 
+/*
+  ShardedCache:
+    Thread-safe front end over nshard caches of any policy, each guarded by its own lock
+    Keys are spread over shards by hash, the limit is split evenly
+    Batch operations group keys by shard and take each shard lock once per batch
+*/
+template <typename cache_key_t, class Data>
+class ShardedCache final : public Cache<cache_key_t, Data> {
+public:
+  typedef typename Cache<cache_key_t, Data>::Accept Accept;
+  typedef std::function<std::unique_ptr<Cache<cache_key_t, Data>>(size_t)> Factory;
+  ShardedCache(size_t limit, size_t nshard, Factory make_shard)
+    : Cache<cache_key_t, Data>(limit), shards_(std::max<size_t>(nshard, 1)) {
+    size_t shard_limit = (limit + shards_.size() - 1) / shards_.size();
+    for (auto &shard : shards_) shard.cache = make_shard(shard_limit);
+  }
+  size_t size() {
+    size_t result = 0;
+    for (auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mtx);
+      result += shard.cache->size();
+    }
+    return result;
+  }
+  Stats stats() {
+    Stats result;
+    for (auto &shard : shards_) {
+      std::lock_guard<std::mutex> lock(shard.mtx);
+      Stats item = shard.cache->stats();
+      result.bytes += item.bytes;
+      result.entries += item.entries;
+      result.hits += item.hits;
+      result.misses += item.misses;
+      result.evictions += item.evictions;
+      result.rejections += item.rejections;
+    }
+    return result;
+  }
+  int count(cache_key_t k) {
+    auto &shard = shards_[index(k)];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    return shard.cache->count(k);
+  }
+  void insert(cache_key_t k, const Data &data) {
+    auto &shard = shards_[index(k)];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    shard.cache->insert(k, data);
+  }
+  void lookup(cache_key_t k, Data &data, const Accept &accept = nullptr) {
+    auto &shard = shards_[index(k)];
+    std::lock_guard<std::mutex> lock(shard.mtx);
+    shard.cache->lookup(k, data, accept);
+  }
+  void insert(const cache_key_t *keys, const Data *data, size_t n) {
+    forEachShard(keys, n, [&](Shard &shard, size_t i) { shard.cache->insert(keys[i], data[i]); });
+  }
+  void lookup(const cache_key_t *keys, Data *data, size_t n, const Accept &accept = nullptr) {
+    forEachShard(keys, n, [&](Shard &shard, size_t i) { shard.cache->lookup(keys[i], data[i], accept); });
+  }
+  void insertMissing(const cache_key_t *keys, const Data *data, size_t n) {
+    forEachShard(keys, n, [&](Shard &shard, size_t i) {
+      if (!shard.cache->count(keys[i])) shard.cache->insert(keys[i], data[i]);
+    });
+  }
+private:
+  struct Shard {
+    std::mutex mtx;
+    std::unique_ptr<Cache<cache_key_t, Data>> cache;
+  };
+  size_t index(cache_key_t k) {
+    return ((uint64_t(std::hash<cache_key_t>()(k)) * 0x9E3779B97F4A7C15ull) >> 32) % shards_.size();
+  }
+  // bucket the keys by shard with a counting sort, then visit each shard under its lock
+  template <typename Fn>
+  void forEachShard(const cache_key_t *keys, size_t n, Fn func) {
+    std::vector<uint32_t> shard_of(n), order(n);
+    std::vector<size_t> start(shards_.size() + 1, 0);
+    for (size_t i = 0; i < n; i++) {
+      shard_of[i] = index(keys[i]);
+      start[shard_of[i] + 1]++;
+    }
+    for (size_t s = 0; s < shards_.size(); s++) start[s + 1] += start[s];
+    std::vector<size_t> pos(start.begin(), start.end() - 1);
+    for (size_t i = 0; i < n; i++) order[pos[shard_of[i]]++] = i;
+    for (size_t s = 0; s < shards_.size(); s++) {
+      if (start[s] == start[s + 1]) continue;
+      std::lock_guard<std::mutex> lock(shards_[s].mtx);
+      for (size_t j = start[s]; j < start[s + 1]; j++) func(shards_[s], order[j]);
+    }
+  }
+  std::vector<Shard> shards_;
+}; // class ShardedCache
+
+/*
+  StaticCache:
+    Read-only cache, the content is given once by build() and never evicted
+    insert is ignored, lookup takes no lock and misses everything until build() is done
+    Thread-safe
+*/
+template <typename cache_key_t, class Data>
+class StaticCache final : public Cache<cache_key_t, Data> {
+private:
+  typedef std::unordered_map<cache_key_t, Data> Table;
+  std::unique_ptr<Table> table_;
+  std::atomic<const Table*> ready_{nullptr};
+  std::atomic<size_t> hits_{0}, misses_{0};
+public:
+  using Cache<cache_key_t, Data>::Cache;
+  typedef typename Cache<cache_key_t, Data>::Accept Accept;
+  // can only be called once, readers see the table as soon as it is published
+  // entries are taken in the given order until the limit is reached
+  void build(const std::vector<std::pair<cache_key_t, Data>> &entries) {
+    if (table_) throw std::runtime_error("StaticCache is already built");
+    table_ = std::make_unique<Table>();
+    for (auto &entry : entries) {
+      size_t cost = this->charge(entry.second);
+      if (this->stats_.bytes + cost > this->limit_) break;
+      this->stats_.bytes += cost;
+      table_->emplace(entry.first, entry.second);
+    }
+    ready_.store(table_.get(), std::memory_order_release);
+  }
+  Stats stats() {
+    Stats result;
+    if (ready_.load(std::memory_order_acquire)) result = this->stats_;
+    result.entries = size();
+    result.hits = hits_;
+    result.misses = misses_;
+    return result;
+  }
+  size_t size() {
+    auto table = ready_.load(std::memory_order_acquire);
+    return table ? table->size() : 0;
+  }
+  int count(cache_key_t k) {
+    auto table = ready_.load(std::memory_order_acquire);
+    return table ? table->count(k) : 0;
+  }
+  void insert(cache_key_t, const Data &) {}
+  void lookup(cache_key_t k, Data &data, const Accept &accept = nullptr) {
+    auto table = ready_.load(std::memory_order_acquire);
+    if (!table) {
+      misses_++;
+      return;
+    }
+    auto iter = table->find(k);
+    if (iter == table->end() || (accept && !accept(iter->second))) {
+      misses_++;
+      return;
+    }
+    hits_++;
+    data = iter->second;
+  }
+}; // class StaticCache
+
 /*
   LFUOptCache:
   Similar to LFU Cache, but performs better under static workload
@@ -76,6 +274,8 @@ private:
     for (int i = 0; i < kUseCntMax; i++) {
       if (!clist[i].empty()) {
         cache_key_t key = clist[i].back().key;
+        this->stats_.bytes -= this->charge(clist[i].back().data);
+        this->stats_.evictions++;
         hash_.erase(key);
         clist[i].pop_back();
         break;
@@ -85,6 +285,7 @@ private:
 
 public:
   using Cache<cache_key_t, Data>::Cache;
+  typedef typename Cache<cache_key_t, Data>::Accept Accept;
   size_t size() {
     return store_.size() + hash_.size();
   }
@@ -94,30 +295,51 @@ public:
   }
 
   void insert(cache_key_t key, const Data &data) {
-    if (store_.count(key)) {
-      store_[key] = data;
+    size_t cost = this->charge(data);
+    if (cost > this->limit_) {
+      this->stats_.rejections++;
       return;
     }
-    auto iter = hash_.find(key);
-    if (iter != hash_.end()) {
-      iter->second->data = data;
+    auto store_ptr = store_.find(key);
+    if (store_ptr != store_.end()) {
+      this->stats_.bytes += cost - this->charge(store_ptr->second);
+      store_ptr->second = data;
     } else {
-      if (size() == this->limit_) {
-        if (hash_.size() > 0) _evict();
-        else return;
+      auto iter = hash_.find(key);
+      if (iter != hash_.end()) {
+        this->stats_.bytes += cost - this->charge(iter->second->data);
+        iter->second->data = data;
+      } else {
+        this->stats_.bytes += cost;
+        hash_[key] = _create(key, data);
       }
-      hash_[key] = _create(key, data);
+    }
+    // promoted entries in store_ are never evicted, drop the new entry if they alone exceed the limit
+    while (this->stats_.bytes > this->limit_ && hash_.size() > 0) _evict();
+    if (this->stats_.bytes > this->limit_ && store_.count(key)) {
+      this->stats_.bytes -= cost;
+      this->stats_.evictions++;
+      store_.erase(key);
     }
   }
 
-  void lookup(cache_key_t k, Data &data) {
+  void lookup(cache_key_t k, Data &data, const Accept &accept = nullptr) {
     auto store_ptr = store_.find(k);
     if (store_ptr != store_.end()) {
+      if (accept && !accept(store_ptr->second)) {
+        this->stats_.misses++;
+        return;
+      }
+      this->stats_.hits++;
       data = store_ptr->second;
       return;
     }
     auto iter = hash_.find(k);
-    if (iter == hash_.end()) return;
+    if (iter == hash_.end() || (accept && !accept(iter->second->data))) {
+      this->stats_.misses++;
+      return;
+    }
+    this->stats_.hits++;
     data = iter->second->data;
     if (iter->second->use + 1 < kUseCntMax) hash_[k] = _increase(iter->second);
     else {
@@ -142,6 +364,7 @@ private:
   std::list<std::pair<cache_key_t, Data>> list_;
 public:
   using Cache<cache_key_t, Data>::Cache;
+  typedef typename Cache<cache_key_t, Data>::Accept Accept;
   size_t size() {
     return hash_.size();
   }
@@ -151,23 +374,36 @@ public:
   }
 
   void insert(cache_key_t k, const Data &data) {
+    size_t cost = this->charge(data);
+    if (cost > this->limit_) {
+      this->stats_.rejections++;
+      return;
+    }
     if (hash_.count(k)) {
       iterator iter = hash_[k];
+      this->stats_.bytes -= this->charge(iter->second);
       list_.erase(iter);
     }
     list_.emplace_front(k, data);
     hash_[k] = list_.begin();
+    this->stats_.bytes += cost;
     // Evict the least resently used if exceeds
-    if (hash_.size() > this->limit_) {
-      auto kv_pair = list_.back();
+    while (this->stats_.bytes > this->limit_) {
+      auto &kv_pair = list_.back();
+      this->stats_.bytes -= this->charge(kv_pair.second);
+      this->stats_.evictions++;
       hash_.erase(kv_pair.first);
       list_.pop_back();
     }
   }
 
-  void lookup(cache_key_t k, Data &data) {
+  void lookup(cache_key_t k, Data &data, const Accept &accept = nullptr) {
     auto iter = hash_.find(k);
-    if (iter == hash_.end()) return;
+    if (iter == hash_.end() || (accept && !accept(iter->second->second))) {
+      this->stats_.misses++;
+      return;
+    }
+    this->stats_.hits++;
     iterator list_iterator = iter->second;
     data = std::move(list_iterator->second);
     // Move the recently used key-value to the front of the list
@@ -236,6 +472,8 @@ private:
   void _evict() {
     auto clist = list_.begin();
     auto key = clist->list.back().key;
+    this->stats_.bytes -= this->charge(clist->list.back().data);
+    this->stats_.evictions++;
     hash_.erase(key);
     clist->list.pop_back();
     if (clist->list.empty())
@@ -243,6 +481,7 @@ private:
   }
 public:
   using Cache<cache_key_t, Data>::Cache;
+  typedef typename Cache<cache_key_t, Data>::Accept Accept;
   size_t size() {
     return hash_.size();
   }
@@ -252,23 +491,182 @@ public:
   }
 
   void insert(cache_key_t k, const Data &data) {
+    size_t cost = this->charge(data);
+    if (cost > this->limit_) {
+      this->stats_.rejections++;
+      return;
+    }
     auto iter = hash_.find(k);
     if (iter == hash_.end()) {
-      if (hash_.size() == this->limit_)
+      while (this->stats_.bytes + cost > this->limit_)
         _evict();
+      this->stats_.bytes += cost;
       hash_[k] = _create(k, data);
     } else {
+      this->stats_.bytes -= this->charge(iter->second->data);
       iter->second->data = data;
       hash_[k] = _increase(iter->second);
+      this->stats_.bytes += cost;
+      while (this->stats_.bytes > this->limit_)
+        _evict();
     }
   }
 
-  void lookup(cache_key_t k, Data &data) {
+  void lookup(cache_key_t k, Data &data, const Accept &accept = nullptr) {
     auto iter = hash_.find(k);
-    if (iter == hash_.end()) return;
+    if (iter == hash_.end() || (accept && !accept(iter->second->data))) {
+      this->stats_.misses++;
+      return;
+    }
+    this->stats_.hits++;
     hash_[k] = _increase(iter->second);
     data = iter->second->data;
   }
 }; // class LFUCache
 
+/*
+  FrequencySketch:
+    Count-min sketch of recent access frequency, 4 rows of counters saturating at 15
+    Every counter is halved once the number of recorded accesses reaches 10x the width,
+    so the sketch follows a shifting working set and old popularity fades out
+*/
+template <typename cache_key_t>
+class FrequencySketch {
+public:
+  explicit FrequencySketch(size_t width = 64) : width_(64), additions_(0) {
+    while (width_ < width) width_ <<= 1;
+    table_.assign(width_ * kDepth, 0);
+  }
+  // keeps the counts, a key at index j of a row moves to j or j + width when the width doubles,
+  // so both new counters start from the old one and estimates never drop below the true count
+  void grow(size_t width) {
+    while (width_ < width) {
+      std::vector<uint8_t> table(width_ * 2 * kDepth);
+      for (int i = 0; i < kDepth; i++) {
+        auto row = table_.begin() + i * width_;
+        std::copy(row, row + width_, table.begin() + i * 2 * width_);
+        std::copy(row, row + width_, table.begin() + i * 2 * width_ + width_);
+      }
+      table_.swap(table);
+      width_ <<= 1;
+    }
+  }
+  size_t width() const { return width_; }
+  void record(cache_key_t k) {
+    uint64_t h = hash(k);
+    bool added = false;
+    for (int i = 0; i < kDepth; i++) {
+      uint8_t &counter = table_[i * width_ + index(h, i)];
+      if (counter < kMaxCount) {
+        counter++;
+        added = true;
+      }
+    }
+    if (added && ++additions_ >= width_ * 10) age();
+  }
+  int frequency(cache_key_t k) const {
+    uint64_t h = hash(k);
+    int result = kMaxCount;
+    for (int i = 0; i < kDepth; i++)
+      result = std::min<int>(result, table_[i * width_ + index(h, i)]);
+    return result;
+  }
+private:
+  void age() {
+    for (auto &counter : table_) counter >>= 1;
+    additions_ /= 2;
+  }
+  static uint64_t hash(cache_key_t k) {
+    return uint64_t(std::hash<cache_key_t>()(k)) * 0x9E3779B97F4A7C15ull;
+  }
+  // rehash with a different offset per row, so that keys colliding in one row rarely collide in all
+  size_t index(uint64_t h, int row) const {
+    uint64_t x = (h + row * 0xBF58476D1CE4E5B9ull) * 0x94D049BB133111EBull;
+    return (x ^ (x >> 31)) & (width_ - 1);
+  }
+  const static int kDepth = 4;
+  const static uint8_t kMaxCount = 15;
+  std::vector<uint8_t> table_;
+  size_t width_, additions_;
+};
+
+/*
+  TinyLFUCache:
+    LRU cache behind a TinyLFU admission filter
+    Every lookup is recorded in a FrequencySketch, a new entry is only admitted if it has been
+    asked for more often than each of the LRU victims it would evict
+    Keeps one-hit wonders (e.g. GlobalNode sampling) from flushing the popular nodes
+*/
+template <typename cache_key_t, class Data>
+class TinyLFUCache final : public Cache<cache_key_t, Data> {
+private:
+  typedef typename std::list<std::pair<cache_key_t, Data>>::iterator iterator;
+  std::unordered_map<cache_key_t, iterator> hash_;
+  std::list<std::pair<cache_key_t, Data>> list_;
+  FrequencySketch<cache_key_t> sketch_;
+
+  void _evict() {
+    auto &kv_pair = list_.back();
+    this->stats_.bytes -= this->charge(kv_pair.second);
+    this->stats_.evictions++;
+    hash_.erase(kv_pair.first);
+    list_.pop_back();
+  }
+  // whether the candidate wins against all the victims needed to make room for cost
+  bool _admit(cache_key_t k, size_t cost) {
+    int freq = sketch_.frequency(k);
+    size_t bytes = this->stats_.bytes;
+    for (auto iter = list_.rbegin(); bytes + cost > this->limit_; ++iter) {
+      if (sketch_.frequency(iter->first) >= freq) return false;
+      bytes -= this->charge(iter->second);
+    }
+    return true;
+  }
+
+public:
+  using Cache<cache_key_t, Data>::Cache;
+  typedef typename Cache<cache_key_t, Data>::Accept Accept;
+  size_t size() {
+    return hash_.size();
+  }
+
+  int count(cache_key_t k) {
+    return hash_.count(k);
+  }
+
+  void insert(cache_key_t k, const Data &data) {
+    size_t cost = this->charge(data);
+    if (cost > this->limit_) {
+      this->stats_.rejections++;
+      return;
+    }
+    auto iter = hash_.find(k);
+    if (iter != hash_.end()) {
+      this->stats_.bytes -= this->charge(iter->second->second);
+      list_.erase(iter->second);
+      hash_.erase(iter);
+    } else if (!_admit(k, cost)) {
+      return;
+    }
+    list_.emplace_front(k, data);
+    hash_[k] = list_.begin();
+    this->stats_.bytes += cost;
+    while (this->stats_.bytes > this->limit_) _evict();
+    // about 4 counters per entry, the counts so far are kept while growing
+    if (hash_.size() * 4 > sketch_.width()) sketch_.grow(hash_.size() * 8);
+  }
+
+  void lookup(cache_key_t k, Data &data, const Accept &accept = nullptr) {
+    sketch_.record(k);
+    auto iter = hash_.find(k);
+    if (iter == hash_.end() || (accept && !accept(iter->second->second))) {
+      this->stats_.misses++;
+      return;
+    }
+    this->stats_.hits++;
+    data = iter->second->second;
+    list_.splice(list_.begin(), list_, iter->second);
+  }
+}; // class TinyLFUCache
+
 } // namespacce cache
@@ -0,0 +1,35 @@
+#pragma once
+
+#include <cstddef>
+
+namespace gather {
+
+/*
+  Gather kernel:
+    Copy n rows of the same length into a contiguous row-major matrix
+    rows[i] points to the source of row i, rows can be scattered anywhere
+    The kernel picks AVX-512/AVX2 at runtime, prefetches upcoming rows and
+    uses non-temporal stores when the output is too large to stay in cache
+*/
+enum class isa {
+  scalar,
+  avx2,
+  avx512,
+};
+
+// the best instruction set supported by this cpu
+isa bestIsa();
+
+/*
+  rows : source pointer of each row
+  n : number of rows
+  row_bytes : length of each row in bytes
+  dst : output buffer, size at least n * row_bytes
+  nthread : split large gathers to the global ThreadPool
+*/
+void gatherRows(const void* const* rows, size_t n, size_t row_bytes, void *dst, size_t nthread = 1);
+
+// Single thread gather with explicit settings, used for benchmark
+void gatherRows(const void* const* rows, size_t n, size_t row_bytes, void *dst, isa level, bool stream);
+
+} // namespace gather
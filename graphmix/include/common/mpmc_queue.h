@@ -0,0 +1,146 @@
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <utility>
+#include <thread>
+#include <type_traits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+/*
+  MPMCBoundedQueue:
+    Bounded lock-free multi-producer multi-consumer ring (Dmitry Vyukov's algorithm)
+    Each cell carries a sequence number telling whether it is ready for the next push or pop,
+    so producers and consumers only contend on one atomic counter each
+    Push and WaitAndPop sleep on a futex only when the queue is full or empty
+    Same interface as ThreadsafeBoundedQueue, the capacity is limit rounded up to a power of two
+*/
+template<typename T> class MPMCBoundedQueue {
+ public:
+  explicit MPMCBoundedQueue(size_t limit) : limit_(limit) {
+    size_t capacity = 2;
+    while (capacity < limit) capacity <<= 1;
+    mask_ = capacity - 1;
+    cells_.reset(new Cell[capacity]);
+    for (size_t i = 0; i < capacity; i++)
+      cells_[i].seq.store(i, std::memory_order_relaxed);
+  }
+  ~MPMCBoundedQueue() {
+    T temp;
+    while (TryPop(&temp));
+  }
+  MPMCBoundedQueue(const MPMCBoundedQueue&) = delete;
+  MPMCBoundedQueue& operator=(const MPMCBoundedQueue&) = delete;
+
+  /**
+   * \brief push an value into the end, wait if the queue is full. threadsafe.
+   * \param new_value the value
+   */
+  void Push(T new_value) {
+    while (!TryPush(new_value)) {
+      waitFor(not_full_, push_waiters_, [this] { return !full(); });
+    }
+  }
+
+  /**
+   * \brief wait until pop an element from the beginning, threadsafe
+   * \param value the poped value
+   */
+  void WaitAndPop(T* value) {
+    while (!TryPop(value)) {
+      waitFor(not_empty_, pop_waiters_, [this] { return !empty(); });
+    }
+  }
+
+  // new_value is only moved from on success
+  bool TryPush(T &new_value) {
+    Cell *cell;
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos);
+      if (diff == 0) {
+        if (enqueue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        return false; // full
+      } else {
+        pos = enqueue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    new (&cell->storage) T(std::move(new_value));
+    cell->seq.store(pos + 1, std::memory_order_release);
+    notify(not_empty_, pop_waiters_);
+    return true;
+  }
+
+  bool TryPop(T* value) {
+    Cell *cell;
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    while (true) {
+      cell = &cells_[pos & mask_];
+      size_t seq = cell->seq.load(std::memory_order_acquire);
+      intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+      if (diff == 0) {
+        if (dequeue_pos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) break;
+      } else if (diff < 0) {
+        return false; // empty
+      } else {
+        pos = dequeue_pos_.load(std::memory_order_relaxed);
+      }
+    }
+    T *item = reinterpret_cast<T*>(&cell->storage);
+    *value = std::move(*item);
+    item->~T();
+    cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+    notify(not_full_, push_waiters_);
+    return true;
+  }
+  const size_t limit_;
+ private:
+  struct Cell {
+    std::atomic<size_t> seq;
+    typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+  };
+
+  bool empty() {
+    size_t pos = dequeue_pos_.load(std::memory_order_relaxed);
+    return intptr_t(cells_[pos & mask_].seq.load(std::memory_order_acquire)) - intptr_t(pos + 1) < 0;
+  }
+  bool full() {
+    size_t pos = enqueue_pos_.load(std::memory_order_relaxed);
+    return intptr_t(cells_[pos & mask_].seq.load(std::memory_order_acquire)) - intptr_t(pos) < 0;
+  }
+
+  // sleep on word until notify() changes it, ready() is checked again after announcing the waiter
+  template <typename Fn>
+  void waitFor(std::atomic<int> &word, std::atomic<int> &waiters, Fn ready) {
+    // a short spin catches the common case where the other side is about to finish
+    for (int i = 0; i < kSpin; i++) {
+      if (ready()) return;
+      std::this_thread::yield();
+    }
+    waiters.fetch_add(1);
+    int val = word.load();
+    if (!ready())
+      syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE, val, nullptr, nullptr, 0);
+    waiters.fetch_sub(1);
+  }
+  // the fence pairs with fetch_add in waitFor, either the waiter sees the new item or we see the waiter
+  void notify(std::atomic<int> &word, std::atomic<int> &waiters) {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (waiters.load(std::memory_order_relaxed) == 0) return;
+    word.fetch_add(1);
+    syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+  }
+
+  static const int kSpin = 16;
+  std::unique_ptr<Cell[]> cells_;
+  size_t mask_;
+  alignas(64) std::atomic<size_t> enqueue_pos_{0};
+  alignas(64) std::atomic<size_t> dequeue_pos_{0};
+  alignas(64) std::atomic<int> not_empty_{0}, pop_waiters_{0};
+  alignas(64) std::atomic<int> not_full_{0}, push_waiters_{0};
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace cache {
+
+/*
+  Cache trace file:
+    the stream of keys looked up in a cache, used to compare cache policies offline (benchmark/cache_bench)
+    layout : magic | key | key | ..., keys are int64 in host byte order
+*/
+const uint64_t kTraceMagic = 0x3130454341525447ull; // "GTRACE01"
+
+/*
+  TraceWriter:
+    Append keys to a trace file, keys are buffered and written in large chunks
+    Thread-safe
+*/
+template <typename cache_key_t>
+class TraceWriter {
+public:
+  explicit TraceWriter(const std::string &path) {
+    file_ = fopen(path.c_str(), "wb");
+    if (!file_) throw std::runtime_error("Cannot open trace file " + path);
+    fwrite(&kTraceMagic, sizeof(kTraceMagic), 1, file_);
+    buffer_.reserve(kBufferSize);
+  }
+  ~TraceWriter() {
+    flush();
+    fclose(file_);
+  }
+  TraceWriter(const TraceWriter&) = delete;
+  TraceWriter& operator=(const TraceWriter&) = delete;
+
+  void record(const cache_key_t *keys, size_t n) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (size_t i = 0; i < n; i++) buffer_.push_back(int64_t(keys[i]));
+    if (buffer_.size() >= kBufferSize) flushLocked();
+  }
+  void flush() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    flushLocked();
+  }
+private:
+  void flushLocked() {
+    fwrite(buffer_.data(), sizeof(int64_t), buffer_.size(), file_);
+    fflush(file_);
+    buffer_.clear();
+  }
+  const static size_t kBufferSize = 1 << 20;
+  FILE *file_;
+  std::mutex mtx_;
+  std::vector<int64_t> buffer_;
+};
+
+// read all keys of a trace file
+inline std::vector<int64_t> readTrace(const std::string &path) {
+  FILE *file = fopen(path.c_str(), "rb");
+  if (!file) throw std::runtime_error("Cannot open trace file " + path);
+  uint64_t magic = 0;
+  if (fread(&magic, sizeof(magic), 1, file) != 1 || magic != kTraceMagic) {
+    fclose(file);
+    throw std::runtime_error(path + " is not a cache trace");
+  }
+  std::vector<int64_t> result;
+  int64_t chunk[4096];
+  size_t n;
+  while ((n = fread(chunk, sizeof(int64_t), 4096, file)) > 0) result.insert(result.end(), chunk, chunk + n);
+  fclose(file);
+  return result;
+}
+
+} // namespace cache
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/*
+  WorkStealingPool:
+    Each worker owns a deque, tasks submitted by a worker go to its own deque and are run LIFO
+    Tasks submitted from outside are spread round robin
+    An idle worker steals the oldest task of the others before going to sleep
+*/
+class WorkStealingPool {
+public:
+  explicit WorkStealingPool(size_t thread_num);
+  ~WorkStealingPool();
+  void Submit(std::function<void()> task);
+  size_t ThreadNum() { return queues_.size(); }
+
+private:
+  struct WorkQueue {
+    std::mutex mtx;
+    std::deque<std::function<void()>> tasks;
+  };
+  bool popLocal(size_t id, std::function<void()> *task);
+  bool steal(size_t id, std::function<void()> *task);
+  void workerLoop(size_t id);
+
+  std::vector<std::unique_ptr<WorkQueue>> queues_;
+  std::vector<std::thread> threads_;
+  std::atomic<size_t> pending_{0}, sleepers_{0}, next_{0};
+  std::mutex sleep_mtx_;
+  std::condition_variable cond_;
+  bool terminate_ = false;
+};
@@ -3,8 +3,10 @@
 #include "ps/kvapp.h"
 #include "graph/remote_handle.h"
 #include "graph/sampler.h"
+#include "graph/graph_store.h"
 #include "common/binding.h"
-#include "common/bounded_queue.h"
+#include "common/mpmc_queue.h"
+#include "common/work_stealing_pool.h"
 
 #include <map>
 
@@ -18,9 +20,12 @@ public:
   void serve(const PSFData<NodePull>::Request &request, PSFData<NodePull>::Response &response);
   void serve(const PSFData<GraphPull>::Request &request, PSFData<GraphPull>::Response &response);
   void serve(const PSFData<MetaPull>::Request &request, PSFData<MetaPull>::Response &response);
+  void serve(const PSFData<NodeSample>::Request &request, PSFData<NodeSample>::Response &response);
+  void serve(const PSFData<NodeWalk>::Request &request, PSFData<NodeWalk>::Response &response);
   static void initBinding(py::module &m);
   void initMeta(py::dict meta);
   void initData(py::array_t<graph_float> f_feat, py::array_t<graph_int> i_feat, py::array_t<node_id> edges);
+  void initDataFromFile(std::string path);
   void push(const GraphMiniBatch &graph, SamplerTag tag);
 
   node_id nNodes() { return num_local_nodes_; }
@@ -28,31 +33,50 @@ public:
   node_id numGraphNodes() { return meta_.num_nodes; }
   size_t iLen() { return meta_.i_len; }
   size_t fLen() { return meta_.f_len; }
-  NodeData getNode(node_id idx) { return nodes_[idx - local_offset_]; }
+  NodeData getNode(node_id idx) { return store_.getNode(idx - local_offset_); }
+  const GraphStore& store() { return store_; }
   bool isLocalNode(node_id idx) { return idx >= local_offset_ && idx < local_offset_ + num_local_nodes_; }
   int getServer(node_id idx);
   void createRemoteHandle(std::unique_ptr<KVApp<GraphHandle>> &app);
-  void initCache(double ratio, cache::policy policy);
+  // the cache holds nbytes of remote nodes, or ratio of the remote nodes if nbytes is 0
+  void initCache(double ratio, cache::policy policy, size_t nbytes);
   auto& getRemote() { return remote_; }
 
   void addSampler(SamplerType type, py::kwargs kwargs);
   void stopSampling();
+  WorkStealingPool* executor() { return executor_.get(); }
+  // take a slot of the graph queue for a new batch, the slot is returned when the batch is pulled
+  bool acquireCredit(SamplerTag tag);
+  // wake all samplers of tag, threadsafe
+  void wakeSamplers(SamplerTag tag);
+  // (cache miss, nonlocal, total) node counts, cache (bytes, entries, hits, misses, evictions)
+  // then the misses that joined a pull already in flight and the nodes too large for the cache
   py::tuple getProfileData() {
-    return py::make_tuple(remote_->cache_miss_cnt_, remote_->nonlocal_cnt_, remote_->total_cnt_);
+    cache::Stats stats = remote_->cacheStats();
+    return py::make_tuple(remote_->cache_miss_cnt_.load(), remote_->nonlocal_cnt_.load(), remote_->total_cnt_.load(),
+      stats.bytes, stats.entries, stats.hits, stats.misses, stats.evictions, remote_->coalesced_cnt_.load(),
+      stats.rejections);
   }
   void setReady();
   py::dict getMeta() { return dict_meta_; }
-  const static int kserverBufferSize=32;
+  const static int kDefaultInflight=32;
 private:
 // ---------------------- static node data -------------------------------------
-  std::vector<NodeData> nodes_;
+  // gather the features of local nodes at index into the response of a NodePull
+  void pullFeature(const std::vector<node_id> &index, PSFData<NodePull>::Response &response);
+  GraphStore store_;
   GraphMetaData meta_;
   node_id num_local_nodes_;
   node_id local_offset_;
   py::dict dict_meta_;
 // ---------------------- sampler management -----------------------------------
-  std::map<SamplerTag, std::unique_ptr<ThreadsafeBoundedQueue<GraphMiniBatch>>> graph_queue_;
+  std::map<SamplerTag, std::unique_ptr<MPMCBoundedQueue<GraphMiniBatch>>> graph_queue_;
+  // batches in flight plus batches in graph_queue_ never exceed the inflight limit of the tag,
+  // the queue is as large as that limit so push never blocks
+  std::map<SamplerTag, std::atomic<int>> credit_;
   std::vector<SamplerPTR> samplers_;
+  std::mutex samplers_mtx_;
+  std::unique_ptr<WorkStealingPool> executor_;
 // ---------------------- Remote data handle -----------------------------------
   std::unique_ptr<RemoteHandle> remote_;
 //----------------------- handle initialization --------------------------------
@@ -0,0 +1,68 @@
+#pragma once
+
+#include "graph/graph_type.h"
+
+namespace ps {
+
+/*
+  ShardHeader:
+    Header of the binary shard file written by graphmix.partition (see shard.py)
+    Sections follow the header in order indptr, indices, f_feat, i_feat
+    Each section starts at a 64-byte aligned offset, all values are little-endian
+*/
+struct ShardHeader {
+  char magic[8]; // "GMXSHARD"
+  uint64_t version;
+  uint64_t num_nodes, num_edges;
+  uint64_t f_len, i_len;
+  int64_t offset; // global index of the first node in this shard
+  uint64_t section[4]; // byte offset of indptr, indices, f_feat, i_feat
+};
+
+const uint64_t kShardVersion = 1;
+const size_t kShardAlignment = 64;
+
+/*
+  GraphStore:
+    Holds the static graph data of a server in a few flat arrays
+    * adjacency is stored in csr format : indptr (n + 1) and indices
+    * features are row-major matrices of shape (n, f_len) and (n, i_len)
+    All node index used here are local index (0 ~ n-1)
+*/
+class GraphStore {
+public:
+  GraphStore() {}
+  void initFeature(size_t num_nodes, SArray<graph_float> f_feat, size_t f_len, SArray<graph_int> i_feat, size_t i_len);
+  // build csr from coo edges (u, v), u is shifted by offset to get the local index
+  void initEdge(const node_id *u, const node_id *v, size_t num_edges, node_id offset);
+  // map a binary shard file, data is served from the mapping without copy
+  void initFromFile(const std::string &path, const GraphMetaData &meta);
+
+  size_t nNodes() const { return num_nodes_; }
+  size_t nEdges() const { return indices_.size(); }
+  size_t fLen() const { return f_len_; }
+  size_t iLen() const { return i_len_; }
+
+  size_t degree(node_id idx) const { return indptr_[idx + 1] - indptr_[idx]; }
+  const node_id* neighbor(node_id idx) const { return indices_.data() + indptr_[idx]; }
+  const graph_float* fFeat(node_id idx) const { return f_feat_.data() + idx * f_len_; }
+  const graph_int* iFeat(node_id idx) const { return i_feat_.data() + idx * i_len_; }
+
+  NodeData getNode(node_id idx) const {
+    NodeData node;
+    node.f_feat = RowView<graph_float>(fFeat(idx), f_len_);
+    node.i_feat = RowView<graph_int>(iFeat(idx), i_len_);
+    node.edge = RowView<node_id>(neighbor(idx), degree(idx));
+    node.valid = true;
+    return node;
+  }
+private:
+  size_t num_nodes_ = 0;
+  size_t f_len_ = 0, i_len_ = 0;
+  SArray<size_t> indptr_;
+  SArray<node_id> indices_;
+  SArray<graph_float> f_feat_;
+  SArray<graph_int> i_feat_;
+};
+
+} // namespace ps
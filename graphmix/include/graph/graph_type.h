@@ -1,23 +1,78 @@
 #pragma once
 
 #include "common/sarray.h"
+#include "common/arena.h"
 #include <unordered_map>
+#include <unordered_set>
 
 typedef long node_id;
 typedef float graph_float;
 typedef int graph_int;
 
-struct _NodeData {
-  std::vector<graph_float> f_feat;
-  std::vector<graph_int> i_feat;
-  std::vector<node_id> edge;
+/*
+  RowView:
+    A read-only view of a contiguous row, it does not own the data
+*/
+template <typename T>
+class RowView {
+public:
+  RowView() : data_(nullptr), size_(0) {}
+  RowView(const T *data, size_t size) : data_(data), size_(size) {}
+  inline const T* data() const { return data_; }
+  inline size_t size() const { return size_; }
+  inline bool empty() const { return size_ == 0; }
+  inline const T* begin() const { return data_; }
+  inline const T* end() const { return data_ + size_; }
+  inline const T& operator[] (size_t i) const { return data_[i]; }
+private:
+  const T *data_;
+  size_t size_;
 };
 
-typedef std::shared_ptr<_NodeData> NodeData;
+// columns of a node, a NodePull may ask for only some of them
+enum NodeColumn {
+  kNodeFeature = 1, // f_feat and i_feat
+  kNodeEdge = 2,
+  kNodeAll = 3,
+  kNodeSample = 4, // edge holds neighbors sampled by the owner server instead of all neighbors, see NodeSample
+  kNodeColumnMax = 8,
+};
+
+// whether a node with columns have can serve a batch needing columns need
+// the full adjacency serves a sample need, the batch samples it locally
+inline bool coversColumns(int have, int need) {
+  if (need & kNodeSample) need = (need & ~kNodeSample) | kNodeEdge;
+  return (have & need) == need;
+}
+
+/*
+  NodeData:
+    A lightweight view of a node's features and neighbors
+    Local nodes point into the GraphStore of the server and have an empty holder
+    Remote nodes keep the buffer they point to alive with holder
+    columns tells which NodeColumn are present, the others are empty
+*/
+struct NodeData {
+  RowView<graph_float> f_feat;
+  RowView<graph_int> i_feat;
+  RowView<node_id> edge;
+  std::shared_ptr<void> holder;
+  bool valid = false;
+  int columns = kNodeAll;
+  explicit operator bool() const { return valid; }
+};
 
-NodeData makeNodeData();
+// Copy a node into a single owned buffer
+NodeData makeNodeData(const graph_float *f_feat, size_t f_len, const graph_int *i_feat, size_t i_len,
+  const node_id *edge, size_t num_edge);
+NodeData makeNodeData(const NodeData &node);
+// memory held by a node copied with makeNodeData, used as the cache charge
+size_t nodeBytes(const NodeData &node);
 
-typedef std::unordered_map<node_id, NodeData> NodePack;
+// containers of sample states live in the arena of the state, see SampleStatePool
+typedef std::unordered_map<node_id, NodeData, std::hash<node_id>, std::equal_to<node_id>,
+  ArenaAllocator<std::pair<const node_id, NodeData>>> NodePack;
+typedef std::unordered_set<node_id, std::hash<node_id>, std::equal_to<node_id>, ArenaAllocator<node_id>> NodeSet;
 
 typedef ssize_t SamplerTag;
 const SamplerTag kInvalidTag = -1;
@@ -25,7 +80,7 @@ const SamplerTag kInvalidTag = -1;
 struct GraphMiniBatch {
   SArray<graph_float> f_feat;
   SArray<graph_int> i_feat;
-  SArray<node_id> csr_i, csr_j;
+  SArray<node_id> csr_i, csr_j; // indptr and indices of the csr graph
   SArray<graph_int> extra;
   SamplerTag tag; // sampler tag
   int type; // sampler type
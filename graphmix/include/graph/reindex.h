@@ -0,0 +1,51 @@
+#pragma once
+
+#include "graph/graph_type.h"
+
+#include <vector>
+
+namespace ps {
+
+/*
+  Reindexer:
+    Map global node ids in a minibatch to 0..n-1 in insertion order
+    Flat open addressing table with linear probing, entries are tagged with a
+    generation number so that reset() is O(1) and memory is reused across batches
+    Not thread safe, each sampler owns one
+*/
+class Reindexer {
+public:
+  // prepare for at most n distinct keys, drops all previous keys
+  void reset(size_t n);
+  // return the index of key, assign the next index if key is new
+  inline node_id insert(node_id key) {
+    size_t pos = slot(key);
+    if (stamp_[pos] != generation_) {
+      stamp_[pos] = generation_;
+      keys_[pos] = key;
+      vals_[pos] = size_++;
+    }
+    return vals_[pos];
+  }
+  // return the index of key, -1 if not found
+  inline node_id find(node_id key) const {
+    size_t pos = slot(key);
+    return stamp_[pos] == generation_ ? vals_[pos] : -1;
+  }
+  size_t size() const { return size_; }
+private:
+  // the slot holding key, or the empty slot where key should be inserted
+  inline size_t slot(node_id key) const {
+    size_t pos = (uint64_t(key) * 0x9E3779B97F4A7C15ull) >> shift_;
+    while (stamp_[pos] == generation_ && keys_[pos] != key)
+      pos = (pos + 1) & mask_;
+    return pos;
+  }
+  std::vector<node_id> keys_, vals_;
+  std::vector<uint32_t> stamp_;
+  uint32_t generation_ = 0;
+  size_t size_ = 0, mask_ = 0;
+  int shift_ = 64;
+};
+
+} // namespace ps
@@ -3,9 +3,12 @@
 #include "graph/sampler.h"
 #include "ps/kvapp.h"
 #include "common/cache.h"
-#include "ps/internal/threadsafe_queue.h"
+#include "common/trace.h"
 
+#include <chrono>
+#include <condition_variable>
 #include <set>
+#include <thread>
 
 namespace ps {
 
@@ -14,24 +17,69 @@ class GraphHandle;
 class RemoteHandle {
 public:
   RemoteHandle(std::unique_ptr<KVApp<GraphHandle>> &, GraphHandle*);
-  void initCache(size_t, cache::policy);
-  void initQueue(SamplerTag tag);
-  void queryRemote(sampleState state);
-  sampleState getSampleState(SamplerType type, SamplerTag tag);
+  ~RemoteHandle();
+  // cache_bytes bounds the memory of cached nodes, see nodeBytes
+  void initCache(size_t cache_bytes, cache::policy);
+  cache::Stats cacheStats();
+  // write the buffered keys of GRAPHMIX_CACHE_TRACE, called when sampling stops
+  void flushTrace() { if (trace_) trace_->flush(); }
+  // pull the query nodes of state, only columns (NodeColumn) are guaranteed to be present
+  // with kNodeSample, owner servers sample fanout neighbors of each node
+  void queryRemote(sampleState state, int columns, int fanout);
+  // send every unfinished walker of a random walk state to the server owning its current node with NodeWalk
+  void walkRemote(sampleState state);
 
   // Profile data
-  size_t total_cnt_ = 0, cache_miss_cnt_ = 0, nonlocal_cnt_ = 0;
+  std::atomic<size_t> total_cnt_{0}, cache_miss_cnt_{0}, nonlocal_cnt_{0};
+  // cache misses served by a pull already in flight for another batch
+  std::atomic<size_t> coalesced_cnt_{0};
 private:
-  // Insert cache, push to recv_queue_ in defaultCallback
+  // hand the state back to its sampler when all its nodes have arrived
   void defaultCallback(const sampleState &state);
-  void partialCallback(sampleState state, SArray<node_id> pull_keys, const PSFData<NodePull>::Response &response);
-  void filterNode(sampleState &state);
+  // count down wait_num of state, calls defaultCallback on the last arrival
+  void arrive(const sampleState &state, int count);
+  // one NodePull to a server, carrying the keys of one or more batches
+  struct PendingPull {
+    int server, columns;
+    SArray<node_id> keys;
+    // each batch and the end of its keys, the keys of a batch are contiguous
+    struct Part {
+      sampleState state;
+      size_t end;
+      int fanout;
+    };
+    std::vector<Part> parts;
+    std::chrono::steady_clock::time_point start;
+  };
+  void partialCallback(const PendingPull &pull, const PSFData<NodePull>::Response &response);
+  void sendPull(PendingPull &&pull);
+  void walkCallback(sampleState state, int server, const std::vector<size_t> &index,
+    const PSFData<NodeWalk>::Response &response);
+  // send pending pulls whose window has expired
+  void flushLoop();
+  void filterNode(sampleState &state, int columns);
+  // fill a read-only cache with the remote nodes of highest local in-degree
+  void initStaticCache(size_t cache_bytes);
+  // nodes per NodePull when filling the static cache
+  const static size_t kStaticPullBatch = 4096;
+  // thread-safe, see cache::ShardedCache
   std::unique_ptr<cache::Cache<node_id, NodeData>> cache_;
-  std::mutex cache_mtx_;
-  std::unordered_map<SamplerTag, std::unique_ptr<ThreadsafeQueue<sampleState>>> recv_queue_;
+  bool static_cache_ = false;
+  std::unique_ptr<cache::TraceWriter<node_id>> trace_;
+  // nodes with a NodePull in flight, and the other batches waiting for them
+  // indexed by the columns of the pull
+  std::unordered_map<node_id, std::vector<sampleState>> inflight_[kNodeColumnMax];
+  std::mutex inflight_mtx_;
+  // pulls waiting to be merged with other batches, one per server and columns, see GRAPHMIX_PULL_WINDOW_US
+  std::vector<PendingPull> pending_;
+  std::chrono::microseconds pull_window_;
+  size_t pull_batch_keys_;
+  std::mutex pending_mtx_;
+  std::condition_variable pending_cv_;
+  bool stop_flush_ = false;
+  std::thread flush_thread_;
   std::shared_ptr<KVApp<GraphHandle>> kvapp_;
   std::shared_ptr<GraphHandle> handle_;
-  std::unordered_map<SamplerTag, std::atomic<int>> on_flight_;
 };
 
 } // namespace ps
@@ -1,8 +1,10 @@
 #pragma once
 #include "graph/graph_type.h"
 #include "graph/random.h"
-#include <thread>
-#include <set>
+#include "graph/reindex.h"
+#include "ps/internal/threadsafe_queue.h"
+#include <atomic>
+#include <condition_variable>
 
 namespace ps {
 
@@ -14,41 +16,94 @@ enum class SamplerType {
   kNumSamplerType,
 };
 
+class BaseSampler;
+
 class _sampleState {
 public:
+  _sampleState() : query_nodes(alloc()), recvNodes(alloc()) {}
+  virtual ~_sampleState() = default;
+  // drop all contents but keep the memory of the arena
+  virtual void clear();
+  // allocator for containers of this state
+  ArenaAllocator<node_id> alloc() { return ArenaAllocator<node_id>(&arena); }
+  // declared first, containers below are allocated in it
+  Arena arena;
   std::mutex mtx;
-  int wait_num;
-  std::unordered_set<node_id> query_nodes;
+  int wait_num = 0;
+  NodeSet query_nodes;
   NodePack recvNodes;
   SamplerType type;
   SamplerTag tag;
+  // the sampler that started this batch, remote pulls resume it there
+  BaseSampler *owner;
 };
 
 class _randomWalkState : public _sampleState {
 public:
-  std::unordered_set<node_id> frontier;
+  _randomWalkState() : frontier(alloc()) {}
+  void clear() override;
+  NodeSet frontier;
   size_t rw_round = 0;
+  // used when walks are continued on remote servers, see RemoteHandle::walkRemote
+  // (current node, remaining steps) of each walker, kept across recycle
+  std::vector<std::pair<node_id, int>> walkers;
+  // remote nodes visited by the walkers, pulled once all walks are finished, written by walk callbacks under mtx
+  std::vector<node_id> visited;
+  bool walk_done = false;
 };
 
 class _graphSageState : public _sampleState {
 public:
-  std::unordered_set<node_id> frontier;
-  std::unordered_set<node_id> core_node;
-  std::set<std::pair<node_id, node_id>> coo;
+  _graphSageState() : frontier(alloc()), core_node(alloc()) {}
+  void clear() override;
+  NodeSet frontier;
+  NodeSet core_node;
+  // sampled edges (neighbor, node), may contain duplicates, kept across recycle
+  std::vector<std::pair<node_id, node_id>> edges;
   size_t expand_round = 0;
 };
 
 typedef std::shared_ptr<_sampleState> sampleState;
 
-sampleState makeSampleState(SamplerType);
+/*
+  SampleStatePool:
+    Recycle the sample states of one sampler
+    States return to the pool when the last reference is dropped, which can happen on any thread
+    A recycled state keeps its arena, so steady state sampling barely touches malloc
+*/
+class SampleStatePool : public std::enable_shared_from_this<SampleStatePool> {
+public:
+  SampleStatePool(BaseSampler *owner, SamplerType type, SamplerTag tag) : owner_(owner), type_(type), tag_(tag) {}
+  sampleState get();
+private:
+  void release(_sampleState *state);
+  std::mutex mtx_;
+  std::vector<std::unique_ptr<_sampleState>> free_;
+  BaseSampler *const owner_;
+  const SamplerType type_;
+  const SamplerTag tag_;
+};
 
 class GraphHandle;
 
+/*
+  BaseSampler:
+    A sampler has no thread of its own, its steps run as tasks on the sampler executor of GraphHandle
+    Each step starts a new batch or continues one whose remote pull has returned, up to constructing it
+    A remote pull completion hands the batch back to its sampler with resume(), which schedules the next step
+    Steps of one sampler never run concurrently, so members like rd_ and reindex_ need no lock
+    A sampler with nothing to do goes idle until wake() is called
+*/
 class BaseSampler {
 public:
   BaseSampler(GraphHandle *handle, SamplerTag tag);
   void sample_start();
-  void join() { thread_.join(); }
+  // schedule a step if the sampler is idle, threadsafe
+  void wake();
+  // continue a batch after its remote pull, threadsafe
+  void resume(sampleState state);
+  // wait until the running step and all remote pulls finish, call after kill()
+  void join();
   void kill() { killed_ = true; }
   virtual ~BaseSampler() = default;
   virtual SamplerType type() = 0;
@@ -56,10 +111,26 @@ public:
 protected:
   const std::shared_ptr<GraphHandle> handle_;
   GraphMiniBatch construct(const NodePack &node_pack);
+  // pull the query nodes of state, the batch continues in a later step
+  // columns (NodeColumn) are the parts of the nodes the batch will use, see RemoteHandle::queryRemote
+  void queryRemote(sampleState state, int columns = kNodeAll, int fanout = 0);
+  // continue the walkers of state on the servers owning their current nodes
+  void walkRemote(sampleState state);
   virtual void sample_once(sampleState) = 0;
+  // reused by every minibatch of this sampler
+  Reindexer reindex_;
 private:
-  std::thread thread_;
-  bool killed_ = false;
+  void step();
+  // a returned batch first, then a new one if the tag has credit
+  bool nextState(sampleState *state);
+  std::shared_ptr<SampleStatePool> pool_;
+  ThreadsafeQueue<sampleState> ready_;
+  // scheduled_ : a step is queued or running, notified_ : wake() was called during the step
+  std::atomic<bool> scheduled_{false}, notified_{false}, killed_{false};
+  // batches waiting for remote pulls
+  std::atomic<int> waiting_{0};
+  std::mutex join_mtx_;
+  std::condition_variable join_cv_;
   const SamplerTag tag_;
 };
 
@@ -89,21 +160,25 @@ private:
 
 class RandomWalkSampler : public BaseSampler {
 public:
-  RandomWalkSampler(GraphHandle *handle, SamplerTag tag, size_t rw_head, size_t rw_length)
-   : BaseSampler(handle, tag), rw_head_(rw_head), rw_length_(rw_length) {}
+  RandomWalkSampler(GraphHandle *handle, SamplerTag tag, size_t rw_head, size_t rw_length, bool pushdown)
+   : BaseSampler(handle, tag), rw_head_(rw_head), rw_length_(rw_length), pushdown_(pushdown) {}
   void sample_once(sampleState);
   SamplerType type() { return SamplerType::kRandomWalk; }
 private:
+  // walk on remote servers with NodeWalk, one round trip per partition crossing instead of per step
+  void walk_once(std::shared_ptr<_randomWalkState> state);
   RandomIndexSelecter rd_;
   const size_t rw_head_;
   const size_t rw_length_;
+  const bool pushdown_;
 };
 
 class GraphSageSampler : public BaseSampler {
 public:
   GraphSageSampler(GraphHandle *handle, SamplerTag tag, size_t batch_size, size_t depth, size_t width,
-    ssize_t train_mask_index, bool subgraph)
-   : BaseSampler(handle, tag), batch_size_(batch_size), depth_(depth), width_(width), subgraph_(subgraph) {
+    ssize_t train_mask_index, bool subgraph, bool pushdown)
+   : BaseSampler(handle, tag), batch_size_(batch_size), depth_(depth), width_(width), subgraph_(subgraph),
+     pushdown_(pushdown) {
      try_build_index(train_mask_index);
     }
   void sample_once(sampleState);
@@ -111,9 +186,13 @@ public:
 private:
   GraphMiniBatch SageConstruct(sampleState);
   RandomIndexSelecter rd_;
+  // scratch buffer of SageConstruct
+  std::vector<node_id> edge_buf_;
   const size_t batch_size_;
   const size_t depth_, width_;
   const bool subgraph_;
+  // sample neighbors of remote nodes on their servers, see NodeSample
+  const bool pushdown_;
   std::vector<node_id> train_index;
   void try_build_index(ssize_t index);
 };
@@ -2,6 +2,7 @@
 
 #include <random>
 #include <thread>
+#include "ps/internal/shm_ring.h"
 #include "ps/internal/van.h"
 #include "ps/internal/customer.h"
 
@@ -19,6 +20,8 @@ private:
   void *context_ = nullptr;
   void *loop_ = nullptr;
   int recv_port_;
+  // the server sends large frames through shared memory
+  ps::ShmReader shm_reader_;
   int bind(int max_retry=40);
   void connect(int target);
   void sendArriveMessage();
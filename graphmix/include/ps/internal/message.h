@@ -103,7 +103,8 @@ struct Meta {
   /** \brief default constructor */
   Meta()
       : app_id(kEmpty), customer_id(kEmpty), timestamp(kEmpty),
-        sender(kEmpty), recver(kEmpty), request(false), priority(kEmpty) {}
+        sender(kEmpty), recver(kEmpty), request(false), priority(kEmpty),
+        shm_mask(0) {}
   std::string DebugString() const {
     std::stringstream ss;
     if (sender == Node::kEmpty) {
@@ -140,6 +141,8 @@ struct Meta {
   int priority;
   /** \brief server-side computation op for keys */
   PsfType psftype;
+  /** \brief bit i is set if data[i] is sent as a \ref ShmFrame, set by the van */
+  int shm_mask;
 };
 /**
  * \brief messages that communicated amaong nodes.
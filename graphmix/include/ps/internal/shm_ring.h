@@ -0,0 +1,230 @@
+/**
+ *  Shared memory transport for the data frames of co-located nodes
+ */
+#ifndef PS_INTERNAL_SHM_RING_H_
+#define PS_INTERNAL_SHM_RING_H_
+#include <dirent.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "common/sarray.h"
+
+namespace ps {
+
+/*
+  ShmFrame:
+    The frame sent through the socket in place of a data frame that was written to shared memory
+    The socket message also acts as the doorbell, the payload is complete before it is sent
+*/
+struct ShmFrame {
+  char name[32]; // segment under /dev/shm
+  uint64_t offset; // of the payload in the segment
+  uint64_t size;
+};
+
+/*
+  ShmRing:
+    Ring of data frames in a segment under /dev/shm, owned by the sending process
+    Each block is | BlockHeader | payload | with the header padded to 64 bytes, so the payload can be cast to any array type
+    The receiver maps the segment and clears busy when the frame is released (see ShmReader),
+    the sender reclaims blocks from the tail in order, a block released early waits for the ones before it
+    write() fails when the ring is full, the frame then goes through the socket as before
+*/
+class ShmRing {
+ public:
+  struct BlockHeader {
+    std::atomic<uint32_t> busy;
+    uint32_t reserved;
+    uint64_t size; // the whole block
+  };
+  static const size_t kAlign = 64;
+  static const size_t kMinCapacity = 1 << 20;
+
+  /**
+   * \brief create a ring of up to capacity bytes, never more than half of the
+   * space left in /dev/shm since touching pages past it raises SIGBUS
+   * \return nullptr if there is no room for it
+   */
+  static ShmRing* create(size_t capacity) {
+    removeStale();
+    struct statvfs st;
+    if (statvfs("/dev/shm", &st) != 0) return nullptr;
+    capacity = std::min<size_t>(capacity, st.f_bavail * st.f_bsize / 2) / kAlign * kAlign;
+    if (capacity < kMinCapacity) {
+      LOG(WARNING) << "not enough space in /dev/shm, frames go through sockets";
+      return nullptr;
+    }
+    std::string name = "graphmix-" + std::to_string(getpid());
+    std::string path = "/dev/shm/" + name;
+    int fd = open(path.c_str(), O_CREAT | O_TRUNC | O_RDWR, 0600);
+    if (fd == -1) return nullptr;
+    void *base = MAP_FAILED;
+    if (ftruncate(fd, capacity) == 0)
+      base = mmap(nullptr, capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (base == MAP_FAILED) {
+      unlink(path.c_str());
+      return nullptr;
+    }
+    return new ShmRing(name, static_cast<char*>(base), capacity);
+  }
+  ~ShmRing() {
+    // receivers keep their own mapping, the segment is gone once they unmap it
+    munmap(base_, capacity_);
+    unlink(("/dev/shm/" + std::string(name_)).c_str());
+  }
+  ShmRing(const ShmRing&) = delete;
+  ShmRing& operator=(const ShmRing&) = delete;
+
+  /**
+   * \brief copy data into a new block. threadsafe
+   * \return false if the ring has no room for it
+   */
+  bool write(const SArray<char> &data, ShmFrame *frame) {
+    size_t need = (kAlign + data.size() + kAlign - 1) / kAlign * kAlign;
+    BlockHeader *block = allocate(need);
+    if (!block) {
+      if (!full_warned_.exchange(true))
+        LOG(WARNING) << "shared memory ring " << name_ << " is full, frames go through sockets until "
+                     << "the oldest frame is released. frames kept by the receiver hold the ring";
+      return false;
+    }
+    char *payload = reinterpret_cast<char*>(block) + kAlign;
+    memcpy(payload, data.data(), data.size());
+    strcpy(frame->name, name_);
+    frame->offset = payload - base_;
+    frame->size = data.size();
+    return true;
+  }
+
+  // give back a block that was written but never sent
+  void discard(const ShmFrame &frame) {
+    reinterpret_cast<BlockHeader*>(base_ + frame.offset - kAlign)->busy.store(0, std::memory_order_release);
+  }
+
+ private:
+  ShmRing(const std::string &name, char *base, size_t capacity) : capacity_(capacity), base_(base) {
+    CHECK_LT(name.size(), sizeof(name_));
+    strcpy(name_, name.c_str());
+  }
+
+  // unlink the segments left by graphmix processes that died without Stop
+  static void removeStale() {
+    DIR *dir = opendir("/dev/shm");
+    if (!dir) return;
+    while (struct dirent *entry = readdir(dir)) {
+      const char *prefix = "graphmix-";
+      if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0) continue;
+      char *end;
+      long pid = strtol(entry->d_name + strlen(prefix), &end, 10);
+      if (*end || pid <= 0) continue;
+      if (kill(pid, 0) == -1 && errno == ESRCH) {
+        unlink(("/dev/shm/" + std::string(entry->d_name)).c_str());
+        LOG(WARNING) << "removed /dev/shm/" << entry->d_name << " left by a dead process";
+      }
+    }
+    closedir(dir);
+  }
+
+  BlockHeader* allocate(size_t need) {
+    std::lock_guard<std::mutex> lk(mu_);
+    reclaim();
+    size_t offset = head_ % capacity_;
+    size_t skip = offset + need > capacity_ ? capacity_ - offset : 0;
+    if (need > capacity_ || head_ + skip + need - tail_ > capacity_) return nullptr;
+    if (skip) {
+      // the block would cross the end, fill the rest of the ring with a free block
+      auto filler = reinterpret_cast<BlockHeader*>(base_ + offset);
+      filler->size = skip;
+      filler->busy.store(0, std::memory_order_relaxed);
+      head_ += skip;
+    }
+    auto block = reinterpret_cast<BlockHeader*>(base_ + head_ % capacity_);
+    block->size = need;
+    block->busy.store(1, std::memory_order_relaxed);
+    head_ += need;
+    return block;
+  }
+
+  void reclaim() {
+    while (tail_ < head_) {
+      auto block = reinterpret_cast<BlockHeader*>(base_ + tail_ % capacity_);
+      if (block->busy.load(std::memory_order_acquire)) break;
+      tail_ += block->size;
+    }
+  }
+
+  const size_t capacity_;
+  char name_[sizeof(ShmFrame::name)];
+  char *base_;
+  std::mutex mu_;
+  std::atomic<bool> full_warned_{false};
+  // positions grow forever, the offset in the ring is position % capacity_
+  size_t head_ = 0, tail_ = 0;
+};
+
+/*
+  ShmReader:
+    Map the segments of the senders and wrap their frames without a copy
+    The block is handed back to the sender when the last SArray referring to it is gone
+*/
+class ShmReader {
+ public:
+  SArray<char> wrap(const char *buf, size_t size) {
+    CHECK_EQ(size, sizeof(ShmFrame)) << "bad shared memory frame";
+    ShmFrame frame;
+    memcpy(&frame, buf, sizeof(frame));
+    std::shared_ptr<Segment> segment = open(frame.name);
+    CHECK_LE(frame.offset + frame.size, segment->size);
+    char *payload = segment->base + frame.offset;
+    auto block = reinterpret_cast<ShmRing::BlockHeader*>(payload - ShmRing::kAlign);
+    SArray<char> data;
+    data.reset(payload, frame.size, [segment, block](char*) {
+      block->busy.store(0, std::memory_order_release);
+    });
+    return data;
+  }
+
+ private:
+  struct Segment {
+    char *base;
+    size_t size;
+    ~Segment() { munmap(base, size); }
+  };
+
+  std::shared_ptr<Segment> open(const char *name) {
+    std::lock_guard<std::mutex> lk(mu_);
+    auto it = segments_.find(name);
+    if (it != segments_.end()) return it->second;
+    std::string path = "/dev/shm/" + std::string(name);
+    int fd = ::open(path.c_str(), O_RDWR);
+    CHECK_NE(fd, -1) << "cannot open " << path << ": " << strerror(errno);
+    struct stat st;
+    CHECK_EQ(fstat(fd, &st), 0) << strerror(errno);
+    void *base = mmap(nullptr, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    CHECK(base != MAP_FAILED) << "cannot map " << path << ": " << strerror(errno);
+    auto segment = std::make_shared<Segment>();
+    segment->base = static_cast<char*>(base);
+    segment->size = st.st_size;
+    segments_[name] = segment;
+    return segment;
+  }
+
+  std::mutex mu_;
+  std::unordered_map<std::string, std::shared_ptr<Segment>> segments_;
+};
+
+}  // namespace ps
+#endif  // PS_INTERNAL_SHM_RING_H_
@@ -106,6 +106,12 @@ class Van {
    */
   virtual int SendMsg(const Message &msg) = 0;
 
+  /**
+   * \brief hand a data message received outside of the \ref Receiving thread
+   * to its customer. thread safe
+   */
+  void DeliverDataMsg(Message *msg, int recv_bytes);
+
   Node scheduler_;
   Node my_node_;
   bool is_scheduler_;
@@ -128,7 +134,7 @@ class Van {
   /** whether it is ready for sending */
   std::atomic<bool> ready_{false};
   std::atomic<size_t> send_bytes_{0};
-  size_t recv_bytes_ = 0;
+  std::atomic<size_t> recv_bytes_{0};
   int num_servers_ = 0;
   int num_workers_ = 0;
   /** the thread for receiving messages */
@@ -191,7 +197,8 @@ class Van {
 
 
 /**
- * \brief pack meta into a string
+ * \brief pack meta into a string, data messages use a fixed binary layout and
+ * control messages use protobuf
  */
 void PackMeta(const Meta &meta, char **meta_buf, int *buf_size);
 
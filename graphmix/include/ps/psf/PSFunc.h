@@ -15,6 +15,8 @@ enum PsfType {
   NodePull,
   GraphPull,
   MetaPull,
+  NodeSample,
+  NodeWalk,
   kNumPSfunction
 };
 
@@ -8,13 +8,82 @@ namespace ps {
 
 template<> struct PSFData<NodePull> {
   using Request = tuple<
-    SArray<node_id> // key
+    SArray<node_id>, // key
+    int // NodeColumn mask of the columns to pull
   >;
   using Response = tuple<
-    SArray<graph_float>,
-    SArray<graph_int>,
-    SArray<node_id>,
-    SArray<size_t>
+    SArray<graph_float>, // float feature, row-major, empty without kNodeFeature
+    SArray<graph_int>, // int feature, row-major, empty without kNodeFeature
+    SArray<node_id>, // edges of all nodes, empty without kNodeEdge
+    SArray<size_t>, // offset of edges, size = key + 1, empty without kNodeEdge
+    int // NodeColumn mask of the response
+  >;
+  // Write views of the response into nodes[0, keys.size()), no data is copied
+  static void _fill(const Response &response, SArray<node_id> keys, NodeData *nodes) {
+    auto &f_feat = get<0>(response);
+    auto &i_feat = get<1>(response);
+    auto &edge = get<2>(response);
+    auto &offset = get<3>(response);
+    int columns = get<4>(response);
+    size_t n = keys.size();
+    bool has_edge = columns & (kNodeEdge | kNodeSample);
+    if (has_edge) {
+      CHECK_EQ(offset.size(), n + 1);
+      CHECK_EQ(offset[n], edge.size());
+    }
+    size_t f_len = f_feat.size() / n, i_len = i_feat.size() / n;
+    // every node shares the response block
+    std::shared_ptr<void> holder = std::make_shared<Response>(response);
+    for (size_t i = 0; i < n; i++) {
+      auto &node = nodes[i];
+      node.f_feat = RowView<graph_float>(f_feat.data() + i * f_len, f_len);
+      node.i_feat = RowView<graph_int>(i_feat.data() + i * i_len, i_len);
+      if (has_edge) node.edge = RowView<node_id>(edge.data() + offset[i], offset[i + 1] - offset[i]);
+      node.holder = holder;
+      node.valid = true;
+      node.columns = columns;
+    }
+  }
+  // Fill the pre-created slots in nodes
+  static void _callback(const Response &response, SArray<node_id> keys, NodePack &nodes) {
+    std::vector<NodeData> views(keys.size());
+    _fill(response, keys, views.data());
+    for (size_t i = 0; i < keys.size(); i++) nodes.at(keys[i]) = std::move(views[i]);
+  }
+};
+
+/*
+  NodeSample:
+    Like NodePull, but the owner server samples fanout neighbors of each node with replacement
+    and only those are sent, so a hub node costs O(fanout) instead of O(degree)
+    A node without neighbor gets none, the response columns are kNodeSample plus kNodeFeature if asked
+*/
+template<> struct PSFData<NodeSample> {
+  using Request = tuple<
+    SArray<node_id>, // key
+    SArray<int>, // fanout of each key
+    int // kNodeFeature to also pull features, or 0
+  >;
+  using Response = PSFData<NodePull>::Response;
+  static void _fill(const Response &response, SArray<node_id> keys, NodeData *nodes) {
+    PSFData<NodePull>::_fill(response, keys, nodes);
+  }
+};
+
+/*
+  NodeWalk:
+    Continue random walks on the server owning their current nodes
+    The server walks each walker for up to its remaining steps and stops early when the walker
+    reaches a node of another server or a node without neighbor
+*/
+template<> struct PSFData<NodeWalk> {
+  using Request = tuple<
+    SArray<node_id>, // current node of each walker
+    SArray<int> // remaining steps of each walker
+  >;
+  using Response = tuple<
+    SArray<node_id>, // nodes visited by all walkers, the current nodes are not included
+    SArray<size_t> // offset of the path of each walker, size = walker + 1
   >;
 };
 
@@ -0,0 +1,168 @@
+#include "common/gather.h"
+#include "common/thread_pool.h"
+
+#include <immintrin.h>
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+
+namespace gather {
+
+namespace {
+
+const size_t kCacheLine = 64;
+// how many rows ahead to prefetch
+const size_t kPrefetchDistance = 4;
+// output larger than this is written with non-temporal store
+const size_t kStreamThreshold = 1 << 22;
+// each thread gathers at least this many bytes
+const size_t kParallelGrain = 1 << 20;
+
+inline void prefetchRow(const void *row, size_t row_bytes) {
+  const char *ptr = static_cast<const char*>(row);
+  for (size_t k = 0; k < row_bytes; k += kCacheLine)
+    __builtin_prefetch(ptr + k, 0, 3);
+}
+
+// bytes needed to align ptr to align
+inline size_t alignHead(const char *ptr, size_t align, size_t limit) {
+  size_t head = (align - (reinterpret_cast<uintptr_t>(ptr) & (align - 1))) & (align - 1);
+  return std::min(head, limit);
+}
+
+void gatherScalar(const void* const* rows, size_t n, size_t row_bytes, char *dst) {
+  for (size_t i = 0; i < n; i++) {
+    if (i + kPrefetchDistance < n) prefetchRow(rows[i + kPrefetchDistance], row_bytes);
+    memcpy(dst + i * row_bytes, rows[i], row_bytes);
+  }
+}
+
+__attribute__((target("avx2")))
+void gatherAVX2(const void* const* rows, size_t n, size_t row_bytes, char *dst, bool stream) {
+  for (size_t i = 0; i < n; i++) {
+    if (i + kPrefetchDistance < n) prefetchRow(rows[i + kPrefetchDistance], row_bytes);
+    const char *src = static_cast<const char*>(rows[i]);
+    char *out = dst + i * row_bytes;
+    size_t k = 0;
+    if (stream) {
+      // streaming store requires aligned destination
+      k = alignHead(out, 32, row_bytes);
+      memcpy(out, src, k);
+      for (; k + 128 <= row_bytes; k += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k + 96));
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(out + k), a);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(out + k + 32), b);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(out + k + 64), c);
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(out + k + 96), d);
+      }
+      for (; k + 32 <= row_bytes; k += 32)
+        _mm256_stream_si256(reinterpret_cast<__m256i*>(out + k),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k)));
+    } else {
+      for (; k + 128 <= row_bytes; k += 128) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k + 32));
+        __m256i c = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k + 64));
+        __m256i d = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k + 96));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k), a);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k + 32), b);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k + 64), c);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k + 96), d);
+      }
+      for (; k + 32 <= row_bytes; k += 32)
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out + k),
+          _mm256_loadu_si256(reinterpret_cast<const __m256i*>(src + k)));
+    }
+    memcpy(out + k, src + k, row_bytes - k);
+  }
+  if (stream) _mm_sfence();
+}
+
+__attribute__((target("avx512f")))
+void gatherAVX512(const void* const* rows, size_t n, size_t row_bytes, char *dst, bool stream) {
+  for (size_t i = 0; i < n; i++) {
+    if (i + kPrefetchDistance < n) prefetchRow(rows[i + kPrefetchDistance], row_bytes);
+    const char *src = static_cast<const char*>(rows[i]);
+    char *out = dst + i * row_bytes;
+    size_t k = 0;
+    if (stream) {
+      k = alignHead(out, 64, row_bytes);
+      memcpy(out, src, k);
+      for (; k + 128 <= row_bytes; k += 128) {
+        __m512i a = _mm512_loadu_si512(src + k);
+        __m512i b = _mm512_loadu_si512(src + k + 64);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(out + k), a);
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(out + k + 64), b);
+      }
+      for (; k + 64 <= row_bytes; k += 64)
+        _mm512_stream_si512(reinterpret_cast<__m512i*>(out + k), _mm512_loadu_si512(src + k));
+    } else {
+      for (; k + 128 <= row_bytes; k += 128) {
+        __m512i a = _mm512_loadu_si512(src + k);
+        __m512i b = _mm512_loadu_si512(src + k + 64);
+        _mm512_storeu_si512(out + k, a);
+        _mm512_storeu_si512(out + k + 64, b);
+      }
+      for (; k + 64 <= row_bytes; k += 64)
+        _mm512_storeu_si512(out + k, _mm512_loadu_si512(src + k));
+    }
+    memcpy(out + k, src + k, row_bytes - k);
+  }
+  if (stream) _mm_sfence();
+}
+
+isa detectIsa() {
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return isa::avx512;
+  if (__builtin_cpu_supports("avx2")) return isa::avx2;
+  return isa::scalar;
+}
+
+} // namespace
+
+isa bestIsa() {
+  static const isa best = detectIsa();
+  return best;
+}
+
+void gatherRows(const void* const* rows, size_t n, size_t row_bytes, void *dst, isa level, bool stream) {
+  char *out = static_cast<char*>(dst);
+  switch (level) {
+  case isa::avx512:
+    gatherAVX512(rows, n, row_bytes, out, stream);
+    break;
+  case isa::avx2:
+    gatherAVX2(rows, n, row_bytes, out, stream);
+    break;
+  default:
+    gatherScalar(rows, n, row_bytes, out);
+  }
+}
+
+void gatherRows(const void* const* rows, size_t n, size_t row_bytes, void *dst, size_t nthread) {
+  size_t total = n * row_bytes;
+  if (total == 0) return;
+  bool stream = total >= kStreamThreshold;
+  nthread = std::min(nthread, total / kParallelGrain);
+  if (nthread <= 1) {
+    gatherRows(rows, n, row_bytes, dst, bestIsa(), stream);
+    return;
+  }
+  // the calling thread takes the first chunk
+  size_t chunk = (n + nthread - 1) / nthread;
+  std::vector<std::future<void>> tasks;
+  for (size_t begin = chunk; begin < n; begin += chunk) {
+    size_t len = std::min(chunk, n - begin);
+    char *out = static_cast<char*>(dst) + begin * row_bytes;
+    tasks.push_back(ThreadPool::Get()->Enqueue([=]() {
+      gatherRows(rows + begin, len, row_bytes, out, bestIsa(), stream);
+    }));
+  }
+  gatherRows(rows, chunk, row_bytes, dst, bestIsa(), stream);
+  for (auto &task : tasks) task.wait();
+}
+
+} // namespace gather
@@ -188,6 +188,12 @@ int Client::RecvMsg(Message* msg) {
       bool more = zmq_msg_more(zmsg);
       delete zmsg;
       if (!more) break;
+    } else if (msg->meta.shm_mask >> (i - 2) & 1) {
+      msg->data.push_back(shm_reader_.wrap(buf, size));
+      bool more = zmq_msg_more(zmsg);
+      zmq_msg_close(zmsg);
+      delete zmsg;
+      if (!more) break;
     } else {
       // zero-copy
       SArray<char> data;
@@ -339,6 +339,35 @@ void PyGraph::initBinding(py::module &m) {
         });
 }
 
-NodeData makeNodeData() {
-  return NodeData(new _NodeData());
+NodeData makeNodeData(const graph_float *f_feat, size_t f_len, const graph_int *i_feat, size_t i_len,
+  const node_id *edge, size_t num_edge) {
+  // layout : edge | f_feat | i_feat, edge is placed first for alignment
+  size_t nbytes = num_edge * sizeof(node_id) + f_len * sizeof(graph_float) + i_len * sizeof(graph_int);
+  std::shared_ptr<char> buffer(new char[nbytes], std::default_delete<char[]>());
+  node_id *edge_ptr = reinterpret_cast<node_id*>(buffer.get());
+  graph_float *f_ptr = reinterpret_cast<graph_float*>(edge_ptr + num_edge);
+  graph_int *i_ptr = reinterpret_cast<graph_int*>(f_ptr + f_len);
+  std::copy(edge, edge + num_edge, edge_ptr);
+  std::copy(f_feat, f_feat + f_len, f_ptr);
+  std::copy(i_feat, i_feat + i_len, i_ptr);
+  NodeData node;
+  node.edge = RowView<node_id>(edge_ptr, num_edge);
+  node.f_feat = RowView<graph_float>(f_ptr, f_len);
+  node.i_feat = RowView<graph_int>(i_ptr, i_len);
+  node.holder = std::move(buffer);
+  node.valid = true;
+  return node;
+}
+
+NodeData makeNodeData(const NodeData &node) {
+  NodeData result = makeNodeData(node.f_feat.data(), node.f_feat.size(), node.i_feat.data(), node.i_feat.size(),
+    node.edge.data(), node.edge.size());
+  result.columns = node.columns;
+  return result;
+}
+
+size_t nodeBytes(const NodeData &node) {
+  // the payload, the NodeData itself, and about one shared_ptr control block plus a hash node of overhead
+  return node.edge.size() * sizeof(node_id) + node.f_feat.size() * sizeof(graph_float)
+    + node.i_feat.size() * sizeof(graph_int) + sizeof(NodeData) + 64;
 }
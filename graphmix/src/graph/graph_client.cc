@@ -45,30 +45,13 @@ GraphClient::pullData_impl(const node_id* indices, size_t n, NodePack &nodes) {
   nodes.reserve(n);
   for (size_t i = 0; i < n; i++) {
     keys[getserver(indices[i])].push_back(indices[i]);
-    nodes[indices[i]] = makeNodeData(); // avoid race condition in callback
+    nodes[indices[i]] = NodeData(); // avoid race condition in callback
   }
   for (int server = 0; server < nserver; server++) {
     if (keys[server].size() == 0) continue;
     auto pull_keys = keys[server];
-    PSFData<NodePull>::Request request(pull_keys);
-    auto callback = [pull_keys] (const PSFData<NodePull>::Response &response, NodePack &nodes){
-      auto f_feat = std::get<0>(response);
-      auto i_feat= std::get<1>(response);
-      auto edge = std::get<2>(response);
-      auto offset = std::get<3>(response);
-      auto f_len = f_feat.size() / (offset.size() - 1), i_len = i_feat.size() / (offset.size() - 1);
-      CHECK_EQ(offset[offset.size() - 1], edge.size()) << std::endl;
-      for (size_t i = 0; i < pull_keys.size(); i++) {
-        auto &node = nodes[pull_keys[i]];
-        node->f_feat.resize(f_len);
-        node->i_feat.resize(i_len);
-        node->edge.resize(offset[i+1]-offset[i]);
-        std::copy(&f_feat[i*f_len], &f_feat[(i + 1) * f_len], node->f_feat.data());
-        std::copy(&i_feat[i*i_len], &i_feat[(i + 1) * i_len], node->i_feat.data());
-        std::copy(&edge[offset[i]], &edge[offset[i+1]], node->edge.data());
-      }
-    };
-    auto cb = std::bind(callback, std::placeholders::_1, std::ref(nodes));
+    PSFData<NodePull>::Request request(pull_keys, kNodeAll);
+    auto cb = getCallBack<NodePull>(pull_keys, std::ref(nodes));
     int ts = kvapp_->Request<NodePull>(request, cb, server);
     timestamps.push_back(ts);
   }
@@ -104,12 +87,10 @@ GraphClient::pullGraph(py::args args) {
     } else {
       CHECK(false) << "Currently, int feature and float feature must not both be zero";
     }
-    // choose the correct format
-    std::string format="coo";
-    if ((csr_i.size() == num_nodes + 1 && csr_i.back() == node_id(csr_j.size())) || csr_i.size() != csr_j.size())
-      format = "csr";
     CHECK(tag != kInvalidTag) << "Empty reply, maybe an invalid sampler is used in client side";
-    auto graph = std::make_shared<PyGraph>(csr_i, csr_j, num_nodes, format);
+    // all samplers produce csr
+    CHECK(csr_i.size() == num_nodes + 1 && csr_i.back() == node_id(csr_j.size())) << "Sampled graph is not csr";
+    auto graph = std::make_shared<PyGraph>(csr_i, csr_j, num_nodes, "csr");
     graph->setFeature(f_feat, i_feat);
     graph->setType(type);
     graph->setTag(tag);
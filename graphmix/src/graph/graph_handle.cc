@@ -1,4 +1,6 @@
 #include "graph/graph_handle.h"
+#include "common/gather.h"
+#include "graph/random.h"
 
 #include "ps/internal/postoffice.h"
 #include "ps/internal/env.h"
@@ -21,30 +23,98 @@ void GraphHandle::serve(const PSFData<NodePull>::Request& request, PSFData<NodeP
   //std::this_thread::sleep_for(std::chrono::milliseconds(100));
   waitReady();
   auto keys = get<0>(request);
+  int columns = get<1>(request);
+  get<4>(response) = columns;
   if (keys.empty()) return;
   size_t n = keys.size();
+  std::vector<node_id> index(n);
+  for (size_t i = 0; i < n; i++) {
+    CHECK(isLocalNode(keys[i])) << "Pull non-local node " << keys[i];
+    index[i] = keys[i] - local_offset_;
+  }
+  // gather column by column, each column is allocated once without initialization
+  if (columns & kNodeFeature) pullFeature(index, response);
+  if (columns & kNodeEdge) {
+    SArray<size_t> offset(n + 1);
+    offset[0] = 0;
+    for (size_t i = 0; i < n; i++) offset[i + 1] = offset[i] + store_.degree(index[i]);
+    SArray<node_id> edge(new node_id[offset[n]], offset[n], true);
+    for (size_t i = 0; i < n; i++)
+      std::copy(store_.neighbor(index[i]), store_.neighbor(index[i]) + store_.degree(index[i]), &edge[offset[i]]);
+    get<2>(response) = edge;
+    get<3>(response) = offset;
+  }
+}
+
+void GraphHandle::serve(const PSFData<NodeSample>::Request& request, PSFData<NodeSample>::Response& response) {
+  waitReady();
+  auto keys = get<0>(request);
+  auto fanout = get<1>(request);
+  int columns = get<2>(request) & kNodeFeature;
+  get<4>(response) = columns | kNodeSample;
+  if (keys.empty()) return;
+  size_t n = keys.size();
+  CHECK_EQ(fanout.size(), n);
+  std::vector<node_id> index(n);
   SArray<size_t> offset(n + 1);
-  SArray<graph_float> f_feat(n * meta_.f_len);
-  SArray<graph_int> i_feat(n * meta_.i_len);
   offset[0] = 0;
   for (size_t i = 0; i < n; i++) {
-    CHECK(keys[i] >= local_offset_ && keys[i] < local_offset_ + num_local_nodes_);
-    auto node = nodes_[keys[i] - local_offset_];
-    offset[i + 1] = offset[i] + node->edge.size();
+    CHECK(isLocalNode(keys[i])) << "Sample non-local node " << keys[i];
+    index[i] = keys[i] - local_offset_;
+    offset[i + 1] = offset[i] + (store_.degree(index[i]) ? fanout[i] : 0);
   }
-  SArray<node_id> edge(offset[n]);
+  if (columns & kNodeFeature) pullFeature(index, response);
+  // server threads serve requests concurrently, each has its own generator
+  thread_local RandomIndexSelecter rd;
+  SArray<node_id> edge(new node_id[offset[n]], offset[n], true);
   for (size_t i = 0; i < n; i++) {
-    auto node = nodes_[keys[i] - local_offset_];
-    std::copy(node->f_feat.begin(), node->f_feat.end(), &f_feat[i * meta_.f_len]);
-    std::copy(node->i_feat.begin(), node->i_feat.end(), &i_feat[i * meta_.i_len]);
-    std::copy(node->edge.begin(), node->edge.end(), &edge[offset[i]]);
+    const node_id *neighbor = store_.neighbor(index[i]);
+    size_t degree = store_.degree(index[i]);
+    for (size_t j = offset[i]; j < offset[i + 1]; j++) edge[j] = neighbor[rd.randInt(degree)];
   }
-  get<0>(response) = f_feat;
-  get<1>(response) = i_feat;
   get<2>(response) = edge;
   get<3>(response) = offset;
 }
 
+void GraphHandle::serve(const PSFData<NodeWalk>::Request& request, PSFData<NodeWalk>::Response& response) {
+  waitReady();
+  auto start = get<0>(request);
+  auto steps = get<1>(request);
+  size_t n = start.size();
+  CHECK_EQ(steps.size(), n);
+  thread_local RandomIndexSelecter rd;
+  SArray<node_id> path;
+  SArray<size_t> offset(n + 1);
+  offset[0] = 0;
+  for (size_t i = 0; i < n; i++) {
+    node_id node = start[i];
+    CHECK(isLocalNode(node)) << "Walk from non-local node " << node;
+    for (int step = 0; step < steps[i]; step++) {
+      size_t degree = store_.degree(node - local_offset_);
+      if (degree == 0) break;
+      node = store_.neighbor(node - local_offset_)[rd.randInt(degree)];
+      path.push_back(node);
+      if (!isLocalNode(node)) break;
+    }
+    offset[i + 1] = path.size();
+  }
+  get<0>(response) = path;
+  get<1>(response) = offset;
+}
+
+void GraphHandle::pullFeature(const std::vector<node_id> &index, PSFData<NodePull>::Response &response) {
+  size_t n = index.size(), f_len = meta_.f_len, i_len = meta_.i_len;
+  SArray<graph_float> f_feat(new graph_float[n * f_len], n * f_len, true);
+  SArray<graph_int> i_feat(new graph_int[n * i_len], n * i_len, true);
+  std::vector<const void*> rows(n);
+  for (size_t i = 0; i < n; i++) rows[i] = store_.fFeat(index[i]);
+  gather::gatherRows(rows.data(), n, f_len * sizeof(graph_float), f_feat.data());
+  for (size_t i = 0; i < n; i++) rows[i] = store_.iFeat(index[i]);
+  gather::gatherRows(rows.data(), n, i_len * sizeof(graph_int), i_feat.data());
+  get<0>(response) = f_feat;
+  get<1>(response) = i_feat;
+}
+
 void GraphHandle::serve(const PSFData<GraphPull>::Request& request, PSFData<GraphPull>::Response& response) {
   waitReady();
   std::vector<SamplerTag> valid_tag;
@@ -74,6 +144,9 @@ void GraphHandle::serve(const PSFData<GraphPull>::Request& request, PSFData<Grap
     SamplerTag final_wait_tag = valid_tag.back();
     graph_queue_[final_wait_tag]->WaitAndPop(&result);
   }
+  // the slot is free, let the samplers start another batch
+  credit_[result.tag]++;
+  wakeSamplers(result.tag);
   std::get<0>(response) = result.f_feat;
   std::get<1>(response) = result.i_feat;
   std::get<2>(response) = result.csr_i;
@@ -124,23 +197,14 @@ void GraphHandle::initData(py::array_t<graph_float> f_feat, py::array_t<graph_in
   CHECK(i_feat.ndim() == 2 && i_feat.shape(0) == num_local_nodes_ && (size_t)i_feat.shape(1) == meta_.i_len);
   CHECK(edges.ndim() == 2 && edges.shape(0) == 2);
   size_t nedges = edges.shape(1);
-  nodes_.resize(num_local_nodes_);
-  for (node_id i = 0; i < num_local_nodes_; i++) {
-    nodes_[i] = makeNodeData();
-    if (fLen()) {
-      nodes_[i]->f_feat.resize(fLen());
-      std::copy(f_feat.data(i, 0), f_feat.data(i, 0) + fLen(), nodes_[i]->f_feat.data());
-    }
-    if (iLen()) {
-      nodes_[i]->i_feat.resize(iLen());
-      std::copy(i_feat.data(i, 0), i_feat.data(i, 0) + iLen(), nodes_[i]->i_feat.data());
-    }
-  }
-  for (size_t i = 0; i < nedges; i++) {
-    node_id u = edges.at(0, i), v = edges.at(1, i);
-    CHECK(u >= local_offset_ && u < local_offset_ + num_local_nodes_);
-    nodes_[u - local_offset_]->edge.push_back(v);
-  }
+  // features are used without copy, edges are converted to csr
+  store_.initFeature(num_local_nodes_, binding::a2s_nocp(f_feat), fLen(), binding::a2s_nocp(i_feat), iLen());
+  store_.initEdge(edges.data(0), edges.data(1), nedges, local_offset_);
+}
+
+void GraphHandle::initDataFromFile(std::string path) {
+  py::gil_scoped_release release;
+  store_.initFromFile(path, meta_);
 }
 
 int GraphHandle::getServer(node_id idx) {
@@ -150,16 +214,30 @@ int GraphHandle::getServer(node_id idx) {
 }
 
 void GraphHandle::stopSampling() {
+  std::unique_lock<std::mutex> lock(samplers_mtx_);
   for (SamplerPTR& sampler : samplers_)
     sampler->kill();
-  // Clean the queue so that sampelrs can stop
-  GraphMiniBatch temp;
-  for (auto& queue : graph_queue_) {
-    while (queue.second->TryPop(&temp));
-  }
+  // a running step may wake samplers, don't hold the lock while waiting for it
+  lock.unlock();
   for (SamplerPTR& sampler : samplers_)
     sampler->join();
+  lock.lock();
   samplers_.clear();
+  // the handles keep each other alive and are never destroyed, the trace tail is written here
+  if (remote_) remote_->flushTrace();
+}
+
+bool GraphHandle::acquireCredit(SamplerTag tag) {
+  auto &credit = credit_[tag];
+  int val = credit.load();
+  while (val > 0 && !credit.compare_exchange_weak(val, val - 1));
+  return val > 0;
+}
+
+void GraphHandle::wakeSamplers(SamplerTag tag) {
+  std::lock_guard<std::mutex> lock(samplers_mtx_);
+  for (SamplerPTR& sampler : samplers_)
+    if (sampler->tag() == tag) sampler->wake();
 }
 
 void GraphHandle::addSampler(SamplerType type, py::kwargs kwargs) {
@@ -175,10 +253,17 @@ void GraphHandle::addSampler(SamplerType type, py::kwargs kwargs) {
     int value = item.second.cast<int>();
     kvs.emplace(key, value);
   }
+  if (!executor_) {
+    size_t nthread = GetEnv("GRAPHMIX_SAMPLER_THREAD", int(std::thread::hardware_concurrency()));
+    executor_ = std::make_unique<WorkStealingPool>(nthread);
+  }
+  // batches of this tag sampled ahead of the workers, including those waiting for remote pulls
+  int inflight = kvs.count("inflight") ? kvs["inflight"] : kDefaultInflight;
+  CHECK(inflight > 0) << "inflight should be positive";
   if (!graph_queue_.count(tag)) {
-    auto ptr = std::make_unique<ThreadsafeBoundedQueue<GraphMiniBatch>>(kserverBufferSize);
+    auto ptr = std::make_unique<MPMCBoundedQueue<GraphMiniBatch>>(inflight);
     graph_queue_.emplace(tag, std::move(ptr));
-    remote_->initQueue(tag);
+    credit_[tag] = inflight;
   } else {
     LF << "Sampler tag should not be duplicated.";
   }
@@ -198,26 +283,29 @@ void GraphHandle::addSampler(SamplerType type, py::kwargs kwargs) {
     case SamplerType::kRandomWalk:
       CHECK(kvs.count("rw_head"));
       CHECK(kvs.count("rw_length"));
-      sampler = std::make_unique<RandomWalkSampler>(this, tag, kvs["rw_head"], kvs["rw_length"]);
+      if (!kvs.count("pushdown")) kvs["pushdown"] = 1;
+      sampler = std::make_unique<RandomWalkSampler>(this, tag, kvs["rw_head"], kvs["rw_length"], bool(kvs["pushdown"]));
       break;
     case SamplerType::kGraphSage:
       CHECK(kvs.count("batch_size"));
       CHECK(kvs.count("depth"));
       CHECK(kvs.count("width"));
       if (!kvs.count("subgraph")) kvs["subgraph"] = 0;
+      if (!kvs.count("pushdown")) kvs["pushdown"] = 1;
       if (kvs.count("index")) {
         ssize_t len = iLen();
         index = (kvs["index"] % len + len) % len;
       } else index = -1;
       sampler = std::make_unique<GraphSageSampler>(
-        this, tag, kvs["batch_size"], kvs["depth"], kvs["width"], index, bool(kvs["subgraph"])
+        this, tag, kvs["batch_size"], kvs["depth"], kvs["width"], index, bool(kvs["subgraph"]), bool(kvs["pushdown"])
       );
       break;
     default:
       LF << "Sampler Not Implemented";
     }
-    sampler->sample_start();
+    std::lock_guard<std::mutex> lock(samplers_mtx_);
     samplers_.push_back(std::move(sampler));
+    samplers_.back()->sample_start();
   }
 }
 
@@ -230,7 +318,8 @@ void GraphHandle::initBinding(py::module& m) {
     .def_property_readonly("meta", &GraphHandle::getMeta)
     .def("init_meta", &GraphHandle::initMeta)
     .def("init_data", &GraphHandle::initData)
-    .def("init_cache", &GraphHandle::initCache)
+    .def("init_data_from_file", &GraphHandle::initDataFromFile)
+    .def("init_cache", &GraphHandle::initCache, py::arg("ratio"), py::arg("policy"), py::arg("nbytes") = 0)
     .def("get_perf", &GraphHandle::getProfileData)
     .def("is_ready", &GraphHandle::setReady)
     .def("add_sampler", &GraphHandle::addSampler)
@@ -254,13 +343,20 @@ void GraphHandle::createRemoteHandle(std::unique_ptr<KVApp<GraphHandle>>& app) {
   remote_ = std::make_unique<RemoteHandle>(app, this);
 }
 
-void GraphHandle::initCache(double ratio, cache::policy policy) {
+void GraphHandle::initCache(double ratio, cache::policy policy, size_t nbytes) {
   CHECK(num_local_nodes_ != 0) << "Data not ready.";
-  ratio = std::min(ratio, 1.0);
-  ratio = std::max(ratio, 0.0);
-  size_t cache_size = size_t(ratio * (meta_.num_nodes - num_local_nodes_));
-  if (cache_size > 0) {
-    remote_->initCache(cache_size, policy);
+  size_t cache_bytes = nbytes;
+  if (cache_bytes == 0) {
+    // ratio of remote nodes, a remote node is estimated to be as large as an average local one
+    ratio = std::min(ratio, 1.0);
+    ratio = std::max(ratio, 0.0);
+    double avg_degree = double(store_.nEdges()) / num_local_nodes_;
+    double node_bytes = meta_.f_len * sizeof(graph_float) + meta_.i_len * sizeof(graph_int)
+      + avg_degree * sizeof(node_id) + sizeof(NodeData) + 64;
+    cache_bytes = size_t(ratio * (meta_.num_nodes - num_local_nodes_) * node_bytes);
+  }
+  if (cache_bytes > 0) {
+    remote_->initCache(cache_bytes, policy);
   }
 }
 
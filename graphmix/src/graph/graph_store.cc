@@ -0,0 +1,95 @@
+#include "graph/graph_store.h"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace ps {
+
+namespace {
+
+// Read-only shared mapping of a whole file, unmapped when released
+class MappedFile {
+public:
+  explicit MappedFile(const std::string &path) {
+    int fd = open(path.c_str(), O_RDONLY);
+    CHECK(fd >= 0) << "Cannot open shard file " << path;
+    struct stat st;
+    CHECK_EQ(fstat(fd, &st), 0);
+    size_ = st.st_size;
+    CHECK(size_ >= sizeof(ShardHeader)) << "Shard file too small " << path;
+    // MAP_SHARED lets servers on the same host share the page cache
+    addr_ = static_cast<char*>(mmap(nullptr, size_, PROT_READ, MAP_SHARED, fd, 0));
+    close(fd);
+    CHECK(addr_ != MAP_FAILED) << "Cannot mmap shard file " << path;
+  }
+  ~MappedFile() { munmap(addr_, size_); }
+  char* data() { return addr_; }
+  size_t size() { return size_; }
+private:
+  char *addr_;
+  size_t size_;
+};
+
+template <typename T>
+SArray<T> mapSection(std::shared_ptr<MappedFile> &file, uint64_t offset, size_t count) {
+  CHECK(offset % kShardAlignment == 0) << "Shard section not aligned";
+  CHECK(offset + count * sizeof(T) <= file->size()) << "Shard section out of range";
+  SArray<T> result;
+  result.reset(reinterpret_cast<T*>(file->data() + offset), count, [file](T*) {});
+  return result;
+}
+
+} // namespace
+
+void GraphStore::initFeature(size_t num_nodes, SArray<graph_float> f_feat, size_t f_len,
+  SArray<graph_int> i_feat, size_t i_len) {
+  num_nodes_ = num_nodes;
+  f_len_ = f_len;
+  i_len_ = i_len;
+  CHECK_EQ(f_feat.size(), num_nodes_ * f_len);
+  CHECK_EQ(i_feat.size(), num_nodes_ * i_len);
+  f_feat_ = f_feat;
+  i_feat_ = i_feat;
+}
+
+void GraphStore::initEdge(const node_id *u, const node_id *v, size_t num_edges, node_id offset) {
+  SArray<size_t> indptr(num_nodes_ + 1, 0);
+  SArray<node_id> indices(num_edges);
+  for (size_t i = 0; i < num_edges; i++) {
+    node_id src = u[i] - offset;
+    CHECK(src >= 0 && size_t(src) < num_nodes_);
+    indptr[src + 1]++;
+  }
+  for (size_t i = 0; i < num_nodes_; i++)
+    indptr[i + 1] += indptr[i];
+  // counting sort keeps the original order of neighbors
+  std::vector<size_t> pos(indptr.begin(), indptr.end() - 1);
+  for (size_t i = 0; i < num_edges; i++) {
+    indices[pos[u[i] - offset]++] = v[i];
+  }
+  indptr_ = indptr;
+  indices_ = indices;
+}
+
+void GraphStore::initFromFile(const std::string &path, const GraphMetaData &meta) {
+  auto file = std::make_shared<MappedFile>(path);
+  const ShardHeader &header = *reinterpret_cast<ShardHeader*>(file->data());
+  CHECK(std::string(header.magic, 8) == "GMXSHARD") << "Not a graphmix shard file " << path;
+  CHECK_EQ(header.version, kShardVersion) << "Shard version mismatch " << path;
+  CHECK_EQ(header.f_len, meta.f_len);
+  CHECK_EQ(header.i_len, meta.i_len);
+  CHECK_EQ(header.offset, meta.offset[meta.rank]);
+  CHECK_EQ(header.num_nodes, size_t(meta.offset[meta.rank + 1] - meta.offset[meta.rank]));
+  num_nodes_ = header.num_nodes;
+  f_len_ = header.f_len;
+  i_len_ = header.i_len;
+  indptr_ = mapSection<size_t>(file, header.section[0], num_nodes_ + 1);
+  indices_ = mapSection<node_id>(file, header.section[1], header.num_edges);
+  f_feat_ = mapSection<graph_float>(file, header.section[2], num_nodes_ * f_len_);
+  i_feat_ = mapSection<graph_int>(file, header.section[3], num_nodes_ * i_len_);
+  CHECK_EQ(indptr_[num_nodes_], header.num_edges) << "Corrupted shard file " << path;
+}
+
+} // namespace ps
@@ -45,15 +45,17 @@ PYBIND11_MODULE(libc_graphmix, m) {
   m.def("start_server", StartServer);
 
   py::bind_map<NodePack>(m, "NodePack");
-  py::class_<_NodeData, NodeData>(m, "NodeData", py::module_local())
-    .def_property_readonly("f", [](NodeData &n){ return binding::vec_nocp(n->f_feat); } )
-    .def_property_readonly("i", [](NodeData &n){ return binding::vec_nocp(n->i_feat); } )
-    .def_property_readonly("e", [](NodeData &n){ return binding::vec_nocp(n->edge); } );
+  py::class_<NodeData>(m, "NodeData", py::module_local())
+    .def_property_readonly("f", [](NodeData &n){ return binding::pt1d_nocp(n.f_feat.data(), n.f_feat.size()); } )
+    .def_property_readonly("i", [](NodeData &n){ return binding::pt1d_nocp(n.i_feat.data(), n.i_feat.size()); } )
+    .def_property_readonly("e", [](NodeData &n){ return binding::pt1d_nocp(n.edge.data(), n.edge.size()); } );
 
   py::enum_<cache::policy>(m, "cache", py::module_local())
     .value("LRU", cache::policy::LRU)
     .value("LFU", cache::policy::LFU)
-    .value("LFUOpt", cache::policy::LFUOpt);
+    .value("LFUOpt", cache::policy::LFUOpt)
+    .value("Static", cache::policy::Static)
+    .value("TinyLFU", cache::policy::TinyLFU);
 
   py::enum_<SamplerType>(m, "sampler", py::module_local())
     .value("LocalNode", SamplerType::kLocalNode)
@@ -0,0 +1,27 @@
+#include "graph/reindex.h"
+
+#include <algorithm>
+
+namespace ps {
+
+void Reindexer::reset(size_t n) {
+  // keep load factor below 0.5
+  size_t capacity = 16;
+  while (capacity < 2 * n) capacity <<= 1;
+  if (capacity > stamp_.size()) {
+    keys_.resize(capacity);
+    vals_.resize(capacity);
+    stamp_.assign(capacity, 0);
+    generation_ = 0;
+  }
+  // a smaller batch still uses the whole table, fewer collisions
+  mask_ = stamp_.size() - 1;
+  shift_ = 64 - __builtin_ctzll(stamp_.size());
+  if (++generation_ == 0) {
+    std::fill(stamp_.begin(), stamp_.end(), 0);
+    generation_ = 1;
+  }
+  size_ = 0;
+}
+
+} // namespace ps
@@ -1,5 +1,6 @@
 #include "graph/remote_handle.h"
 #include "graph/graph_handle.h"
+#include "ps/internal/utils.h"
 
 namespace ps {
 
@@ -7,137 +8,437 @@ RemoteHandle::RemoteHandle(std::unique_ptr<KVApp<GraphHandle>> &app, GraphHandle
   CHECK(app);
   kvapp_ = std::move(app);
   handle_ = handle->shared_from_this();
+  // record the remote nodes looked up by samplers, one file per server, see benchmark/cache_bench
+  std::string trace_path = GetEnv("GRAPHMIX_CACHE_TRACE", std::string());
+  if (!trace_path.empty())
+    trace_ = std::make_unique<cache::TraceWriter<node_id>>(trace_path + "." + std::to_string(Postoffice::Get()->my_rank()));
+  // NodePulls of concurrent batches to the same server are merged for up to the window or the key limit
+  pull_window_ = std::chrono::microseconds(GetEnv("GRAPHMIX_PULL_WINDOW_US", 0));
+  pull_batch_keys_ = GetEnv("GRAPHMIX_PULL_BATCH_KEYS", 4096);
+  if (pull_window_.count() > 0) {
+    pending_.resize(Postoffice::Get()->num_servers() * kNodeColumnMax);
+    flush_thread_ = std::thread(&RemoteHandle::flushLoop, this);
+  }
+}
+
+RemoteHandle::~RemoteHandle() {
+  if (flush_thread_.joinable()) {
+    {
+      std::lock_guard<std::mutex> lock(pending_mtx_);
+      stop_flush_ = true;
+    }
+    pending_cv_.notify_one();
+    flush_thread_.join();
+  }
 }
 
-void RemoteHandle::initCache(size_t cache_size, cache::policy cache_policy) {
+void RemoteHandle::initCache(size_t cache_bytes, cache::policy cache_policy) {
   CHECK(!cache_) << "Already have a cache";
+  std::function<std::unique_ptr<cache::Cache<node_id, NodeData>>(size_t)> make_shard;
   switch (cache_policy)
   {
   case cache::policy::LRU:
-    cache_ = std::make_unique<cache::LRUCache<node_id, NodeData>>(cache_size);
+    make_shard = [](size_t limit) { return std::make_unique<cache::LRUCache<node_id, NodeData>>(limit, nodeBytes); };
     break;
   case cache::policy::LFU:
-    cache_ = std::make_unique<cache::LFUCache<node_id, NodeData>>(cache_size);
+    make_shard = [](size_t limit) { return std::make_unique<cache::LFUCache<node_id, NodeData>>(limit, nodeBytes); };
     break;
   case cache::policy::LFUOpt:
-    cache_ = std::make_unique<cache::LFUOptCache<node_id, NodeData>>(cache_size);
+    make_shard = [](size_t limit) { return std::make_unique<cache::LFUOptCache<node_id, NodeData>>(limit, nodeBytes); };
+    break;
+  case cache::policy::TinyLFU:
+    make_shard = [](size_t limit) { return std::make_unique<cache::TinyLFUCache<node_id, NodeData>>(limit, nodeBytes); };
     break;
+  case cache::policy::Static:
+    initStaticCache(cache_bytes);
+    return;
   default:
-    std::runtime_error("Cache Policy Error");
+    throw std::runtime_error("Cache Policy Error");
   }
+  // small caches are not split, so that the policy still sees the whole working set. a shard also
+  // keeps room for a few of the largest nodes, hubs are the most worth caching on skewed graphs
+  // and a node larger than its shard is never cached. the local degrees stand in for remote ones
+  const GraphStore &store = handle_->store();
+  size_t max_degree = 0;
+  for (size_t i = 0; i < store.nNodes(); i++) max_degree = std::max(max_degree, store.degree(i));
+  size_t max_node_bytes = handle_->fLen() * sizeof(graph_float) + handle_->iLen() * sizeof(graph_int) +
+    max_degree * sizeof(node_id) + sizeof(NodeData);
+  size_t min_shard_bytes = std::max<size_t>(1 << 20, 4 * max_node_bytes);
+  size_t nshard = std::min<size_t>(GetEnv("GRAPHMIX_CACHE_SHARD", 16), std::max<size_t>(cache_bytes / min_shard_bytes, 1));
+  cache_ = std::make_unique<cache::ShardedCache<node_id, NodeData>>(cache_bytes, nshard, make_shard);
 }
 
-void RemoteHandle::initQueue(SamplerTag tag) {
-  auto ptr = std::make_unique<ThreadsafeQueue<sampleState>>();
-  recv_queue_.emplace(tag, std::move(ptr));
-  on_flight_[tag] = 0;
+cache::Stats RemoteHandle::cacheStats() {
+  return cache_ ? cache_->stats() : cache::Stats();
 }
 
-void RemoteHandle::defaultCallback(const sampleState &state) {
-  CHECK(state);
-  // cache insert
-  if (cache_) {
-    std::lock_guard<std::mutex> lock(cache_mtx_);
-    for (node_id node : state->query_nodes) {
-      CHECK(state->recvNodes[node]);
-      cache_->insert(node, state->recvNodes[node]);
+void RemoteHandle::initStaticCache(size_t cache_bytes) {
+  // count how often local edges point to each remote node, local sampling walks into these the most
+  const GraphStore &store = handle_->store();
+  std::unordered_map<node_id, uint32_t> in_degree;
+  for (size_t i = 0; i < store.nNodes(); i++) {
+    const node_id *neighbor = store.neighbor(i);
+    for (size_t j = 0; j < store.degree(i); j++)
+      if (!handle_->isLocalNode(neighbor[j])) in_degree[neighbor[j]]++;
+  }
+  std::vector<std::pair<uint32_t, node_id>> rank;
+  rank.reserve(in_degree.size());
+  for (auto &kv : in_degree) rank.emplace_back(kv.second, kv.first);
+  // no node is smaller than its features, pulling more than that can never fit
+  size_t min_bytes = handle_->fLen() * sizeof(graph_float) + handle_->iLen() * sizeof(graph_int) + sizeof(NodeData);
+  size_t max_nodes = cache_bytes / min_bytes;
+  if (rank.size() > max_nodes) {
+    std::nth_element(rank.begin(), rank.begin() + max_nodes, rank.end(), std::greater<std::pair<uint32_t, node_id>>());
+    rank.resize(max_nodes);
+  }
+  // build() takes the nodes in this order until the budget is used up
+  std::sort(rank.begin(), rank.end(), std::greater<std::pair<uint32_t, node_id>>());
+  auto cache = std::make_unique<cache::StaticCache<node_id, NodeData>>(cache_bytes, nodeBytes);
+  auto static_cache = cache.get();
+  cache_ = std::move(cache);
+  static_cache_ = true;
+
+  // pull the chosen nodes in the background, other servers might not be ready yet
+  struct Fill {
+    NodePack nodes;
+    std::vector<node_id> order;
+    std::atomic<int> wait_num{0};
+  };
+  auto fill = std::make_shared<Fill>();
+  fill->order.reserve(rank.size());
+  int nserver = Postoffice::Get()->num_servers();
+  std::vector<std::vector<SArray<node_id>>> keys(nserver);
+  for (auto &item : rank) {
+    auto &server_keys = keys[handle_->getServer(item.second)];
+    if (server_keys.empty() || server_keys.back().size() == kStaticPullBatch) server_keys.emplace_back();
+    server_keys.back().push_back(item.second);
+    // pre-create the slot, callbacks only write existing entries
+    fill->nodes[item.second];
+    fill->order.push_back(item.second);
+  }
+  for (auto &server_keys : keys) fill->wait_num += server_keys.size();
+  if (fill->wait_num == 0) {
+    static_cache->build({});
+    return;
+  }
+  for (int server = 0; server < nserver; server++) {
+    for (auto &request_keys : keys[server]) {
+      PSFData<NodePull>::Request request(request_keys, kNodeAll);
+      auto cb = [fill, request_keys, static_cache](const PSFData<NodePull>::Response &response) {
+        PSFData<NodePull>::_callback(response, request_keys, fill->nodes);
+        if (--fill->wait_num == 0) {
+          std::vector<std::pair<node_id, NodeData>> entries;
+          entries.reserve(fill->order.size());
+          // compact the nodes so that the cache does not pin whole responses, see nodeBytes
+          for (node_id node : fill->order) entries.emplace_back(node, makeNodeData(fill->nodes[node]));
+          static_cache->build(entries);
+          PS_VLOG(1) << "Static cache ready with " << static_cache->size() << " nodes";
+        }
+      };
+      kvapp_->Request<NodePull>(request, cb, server);
     }
   }
-  recv_queue_[state->tag]->Push(state);
-  on_flight_[state->tag]--;
 }
 
-void RemoteHandle::partialCallback(sampleState state, SArray<node_id> pull_keys, const PSFData<NodePull>::Response &response) {
+void RemoteHandle::defaultCallback(const sampleState &state) {
   CHECK(state);
-
-  auto f_feat = std::get<0>(response);
-  auto i_feat= std::get<1>(response);
-  auto edge = std::get<2>(response);
-  auto offset = std::get<3>(response);
-  auto f_len = handle_->fLen(), i_len = handle_->iLen();
-  CHECK_EQ(offset[offset.size() - 1], edge.size());
-  for (size_t i = 0; i < pull_keys.size(); i++) {
-    auto &node = state->recvNodes[pull_keys[i]];
-    node->f_feat.resize(f_len);
-    node->i_feat.resize(i_len);
-    node->edge.resize(offset[i+1]-offset[i]);
-    std::copy(&f_feat[i*f_len], &f_feat[(i + 1) * f_len], node->f_feat.data());
-    std::copy(&i_feat[i*i_len], &i_feat[(i + 1) * i_len], node->i_feat.data());
-    std::copy(&edge[offset[i]], &edge[offset[i+1]], node->edge.data());
+  for (node_id node : state->query_nodes) {
+    auto iter = state->recvNodes.find(node);
+    CHECK(iter != state->recvNodes.end() && iter->second) << "Node " << node << " not received";
   }
+  state->owner->resume(state);
+}
+
+void RemoteHandle::arrive(const sampleState &state, int count) {
   state->mtx.lock();
-  int wait_num = state->wait_num--;
+  state->wait_num -= count;
+  int wait_num = state->wait_num;
   state->mtx.unlock();
-  if (wait_num == 1) defaultCallback(state);
+  if (wait_num == 0) defaultCallback(state);
+}
+
+// the neighbors sampled by the owner server with the features cached here, keeps both buffers alive
+static NodeData joinSample(const NodeData &cached, NodeData &&sampled) {
+  sampled.f_feat = cached.f_feat;
+  sampled.i_feat = cached.i_feat;
+  sampled.columns |= kNodeFeature;
+  sampled.holder = std::make_shared<std::pair<std::shared_ptr<void>, std::shared_ptr<void>>>(
+    cached.holder, std::move(sampled.holder));
+  return std::move(sampled);
 }
 
-sampleState RemoteHandle::getSampleState(SamplerType type, SamplerTag tag) {
-  sampleState state;
-  bool success = false;
-  success = recv_queue_[tag]->TryPop(&state);
-  if (success) {
-    return state;
-  } else if (on_flight_[tag] > handle_->kserverBufferSize) {
-    recv_queue_[tag]->WaitAndPop(&state);
-    return state;
+void RemoteHandle::partialCallback(const PendingPull &pull, const PSFData<NodePull>::Response &response) {
+  size_t n = pull.keys.size();
+  std::vector<NodeData> nodes(n);
+  PSFData<NodePull>::_fill(response, pull.keys, nodes.data());
+  bool sampled = pull.columns & kNodeSample;
+  // cache insert, sampled neighbors belong to one batch and are never shared
+  if (cache_ && !static_cache_ && (!sampled || (pull.columns & kNodeFeature))) {
+    // received nodes share the response buffer, compact them so that cache entries don't pin it
+    std::vector<NodeData> compact;
+    compact.reserve(n);
+    for (auto &node : nodes) {
+      compact.push_back(makeNodeData(node));
+      if (sampled) {
+        compact.back().edge = RowView<node_id>();
+        compact.back().columns = kNodeFeature;
+      }
+    }
+    // a partial node must not replace a full entry of the same key, full pulls can only upgrade
+    int columns = sampled ? int(kNodeFeature) : pull.columns;
+    if (columns == kNodeAll) cache_->insert(pull.keys.data(), compact.data(), n);
+    else cache_->insertMissing(pull.keys.data(), compact.data(), n);
+  }
+  // the batches that asked for a node while this pull was in flight, (batch, index of the node)
+  std::vector<std::pair<sampleState, size_t>> waiters;
+  if (!sampled) {
+    std::lock_guard<std::mutex> lock(inflight_mtx_);
+    auto &inflight = inflight_[pull.columns];
+    for (size_t i = 0; i < n; i++) {
+      auto iter = inflight.find(pull.keys[i]);
+      for (auto &waiter : iter->second) waiters.emplace_back(std::move(waiter), i);
+      inflight.erase(iter);
+    }
+  }
+  // group by batch, so that each waiting batch is counted down once
+  std::sort(waiters.begin(), waiters.end(),
+    [](const std::pair<sampleState, size_t> &a, const std::pair<sampleState, size_t> &b) { return a.first < b.first; });
+  for (size_t i = 0, j; i < waiters.size(); i = j) {
+    for (j = i; j < waiters.size() && waiters[j].first == waiters[i].first; j++)
+      waiters[i].first->recvNodes.at(pull.keys[waiters[j].second]) = nodes[waiters[j].second];
+    arrive(waiters[i].first, j - i);
+  }
+  // the keys of each batch in the pull are contiguous
+  // a sampling pull without features was sent for nodes whose features the batch found in the cache
+  bool join = sampled && !(pull.columns & kNodeFeature);
+  size_t begin = 0;
+  for (auto &part : pull.parts) {
+    for (size_t i = begin; i < part.end; i++) {
+      NodeData &slot = part.state->recvNodes.at(pull.keys[i]);
+      slot = join && slot ? joinSample(slot, std::move(nodes[i])) : std::move(nodes[i]);
+    }
+    begin = part.end;
+    arrive(part.state, 1);
+  }
+}
+
+void RemoteHandle::sendPull(PendingPull &&pull) {
+  int server = pull.server;
+  auto shared = std::make_shared<PendingPull>(std::move(pull));
+  auto cb = [this, shared](const PSFData<NodePull>::Response &response) { partialCallback(*shared, response); };
+  if (shared->columns & kNodeSample) {
+    SArray<int> fanout(new int[shared->keys.size()], shared->keys.size(), true);
+    size_t begin = 0;
+    for (auto &part : shared->parts) {
+      std::fill(fanout.begin() + begin, fanout.begin() + part.end, part.fanout);
+      begin = part.end;
+    }
+    PSFData<NodeSample>::Request request(shared->keys, fanout, shared->columns & kNodeFeature);
+    kvapp_->Request<NodeSample>(request, cb, server);
   } else {
-    state = makeSampleState(type);
-    state->tag = tag;
-    return state;
+    PSFData<NodePull>::Request request(shared->keys, shared->columns);
+    kvapp_->Request<NodePull>(request, cb, server);
+  }
+}
+
+void RemoteHandle::flushLoop() {
+  std::unique_lock<std::mutex> lock(pending_mtx_);
+  while (!stop_flush_) {
+    auto now = std::chrono::steady_clock::now();
+    auto deadline = std::chrono::steady_clock::time_point::max();
+    std::vector<PendingPull> ready;
+    for (auto &pull : pending_) {
+      if (pull.keys.empty()) continue;
+      if (pull.start + pull_window_ <= now) {
+        ready.push_back(std::move(pull));
+        pull = PendingPull();
+      } else {
+        deadline = std::min(deadline, pull.start + pull_window_);
+      }
+    }
+    if (!ready.empty()) {
+      lock.unlock();
+      for (auto &pull : ready) sendPull(std::move(pull));
+      lock.lock();
+      continue;
+    }
+    if (deadline == std::chrono::steady_clock::time_point::max()) pending_cv_.wait(lock);
+    else pending_cv_.wait_until(lock, deadline);
   }
 }
 
-void RemoteHandle::queryRemote(sampleState state) {
+void RemoteHandle::queryRemote(sampleState state, int columns, int fanout) {
   CHECK(state != nullptr);
+  CHECK(!(columns & kNodeSample) || fanout > 0) << "Sampling pull without fanout";
   CHECK(state->wait_num == 0);
-  on_flight_[state->tag]++;
-  filterNode(state);
+  filterNode(state, columns);
   int nserver = Postoffice::Get()->num_servers();
-  std::vector<SArray<node_id>> keys(nserver);
-  for (node_id node : state->query_nodes) {
-    keys[handle_->getServer(node)].push_back(node);
+  // nodes whose features were found in the cache only need the sample, see filterNode
+  int sample_columns = columns & ~kNodeFeature;
+  std::vector<SArray<node_id>> keys(nserver), sample_keys(nserver);
+  // one count for each pull, each node taken from another batch's pull, and this function itself,
+  // so that callbacks firing before all requests are sent can't finish the batch
+  state->wait_num = 1;
+  {
+    std::lock_guard<std::mutex> lock(inflight_mtx_);
+    for (node_id node : state->query_nodes) {
+      // join a pull of the same node with all the columns needed, sampling pulls are never in the table
+      std::vector<sampleState> *waiters = nullptr;
+      for (int pull_columns : {columns, int(kNodeAll)}) {
+        auto iter = inflight_[pull_columns].find(node);
+        if (iter != inflight_[pull_columns].end()) {
+          waiters = &iter->second;
+          break;
+        }
+      }
+      if (waiters) {
+        // already being pulled by another batch, wait for that response
+        waiters->push_back(state);
+        state->wait_num++;
+        coalesced_cnt_++;
+      } else {
+        if (!(columns & kNodeSample)) inflight_[columns].emplace(node, std::vector<sampleState>());
+        bool cached = sample_columns != columns && state->recvNodes.at(node);
+        (cached ? sample_keys : keys)[handle_->getServer(node)].push_back(node);
+      }
+    }
+    for (int server = 0; server < nserver; server++) {
+      if (keys[server].size()) state->wait_num++;
+      if (sample_keys[server].size()) state->wait_num++;
+    }
+  }
+  std::vector<PendingPull> ready;
+  for (auto pulls : {std::make_pair(columns, &keys), std::make_pair(sample_columns, &sample_keys)}) {
+    int pull_columns = pulls.first;
+    auto &pull_keys = *pulls.second;
+    if (pull_window_.count() == 0) {
+      for (int server = 0; server < nserver; server++) {
+        if (pull_keys[server].size() == 0) continue;
+        PendingPull pull;
+        pull.server = server;
+        pull.columns = pull_columns;
+        pull.parts.push_back({state, pull_keys[server].size(), fanout});
+        pull.keys = pull_keys[server];
+        ready.push_back(std::move(pull));
+      }
+    } else {
+      // merge into the pending pull of each server and columns, full pulls are sent now and the rest by flushLoop
+      std::lock_guard<std::mutex> lock(pending_mtx_);
+      for (int server = 0; server < nserver; server++) {
+        if (pull_keys[server].size() == 0) continue;
+        auto &pull = pending_[server * kNodeColumnMax + pull_columns];
+        if (pull.keys.empty()) {
+          pull.server = server;
+          pull.columns = pull_columns;
+          pull.keys.reserve(pull_batch_keys_);
+          pull.start = std::chrono::steady_clock::now();
+          pending_cv_.notify_one();
+        }
+        pull.keys.append(pull_keys[server]);
+        pull.parts.push_back({state, pull.keys.size(), fanout});
+        if (pull.keys.size() >= pull_batch_keys_) {
+          ready.push_back(std::move(pull));
+          pull = PendingPull();
+        }
+      }
+    }
   }
+  for (auto &pull : ready) sendPull(std::move(pull));
+  arrive(state, 1);
+}
 
-  for (int server = 0; server < nserver; server++) {
-    if (keys[server].size()) state->wait_num++;
+void RemoteHandle::walkRemote(sampleState state_base) {
+  CHECK(state_base != nullptr);
+  CHECK(state_base->wait_num == 0);
+  auto state = std::static_pointer_cast<_randomWalkState>(state_base);
+  int nserver = Postoffice::Get()->num_servers();
+  std::vector<SArray<node_id>> start(nserver);
+  std::vector<SArray<int>> steps(nserver);
+  std::vector<std::vector<size_t>> index(nserver);
+  for (size_t i = 0; i < state->walkers.size(); i++) {
+    auto &walker = state->walkers[i];
+    if (walker.second == 0) continue;
+    int server = handle_->getServer(walker.first);
+    start[server].push_back(walker.first);
+    steps[server].push_back(walker.second);
+    index[server].push_back(i);
   }
-  // If no remote pull, push back immediately
-  if (state->wait_num == 0) defaultCallback(state);
+  // the same guard as queryRemote
+  state->wait_num = 1;
+  for (int server = 0; server < nserver; server++)
+    if (start[server].size()) state->wait_num++;
   for (int server = 0; server < nserver; server++) {
-    if (keys[server].size() == 0) continue;
-    PSFData<NodePull>::Request request(keys[server]);
-    auto cb = std::bind(&RemoteHandle::partialCallback, this, state, keys[server], std::placeholders::_1);
-    kvapp_->Request<NodePull>(request, cb, server);
+    if (start[server].empty()) continue;
+    PSFData<NodeWalk>::Request request(start[server], steps[server]);
+    auto server_index = std::move(index[server]);
+    auto cb = [this, state, server, server_index](const PSFData<NodeWalk>::Response &response) {
+      walkCallback(state, server, server_index, response);
+    };
+    kvapp_->Request<NodeWalk>(request, cb, server);
   }
+  arrive(state, 1);
 }
 
-void RemoteHandle::filterNode(sampleState &state) {
+void RemoteHandle::walkCallback(sampleState state_base, int server, const std::vector<size_t> &index,
+  const PSFData<NodeWalk>::Response &response) {
+  auto state = std::static_pointer_cast<_randomWalkState>(state_base);
+  auto &path = get<0>(response);
+  auto &offset = get<1>(response);
+  CHECK_EQ(offset.size(), index.size() + 1);
+  {
+    // callbacks of different servers update different walkers, but share visited
+    std::lock_guard<std::mutex> lock(state->mtx);
+    for (size_t i = 0; i < index.size(); i++) {
+      auto &walker = state->walkers[index[i]];
+      size_t len = offset[i + 1] - offset[i];
+      state->visited.insert(state->visited.end(), path.begin() + offset[i], path.begin() + offset[i + 1]);
+      CHECK_LE(len, static_cast<size_t>(walker.second)) << "Walk longer than the steps left";
+      walker.second -= static_cast<int>(len);
+      // a walker stopping on the server it was sent to has reached a node without neighbor
+      if (len == 0 || handle_->getServer(path[offset[i + 1] - 1]) == server) walker.second = 0;
+      else walker.first = path[offset[i + 1] - 1];
+    }
+  }
+  arrive(state, 1);
+}
+
+void RemoteHandle::filterNode(sampleState &state, int columns) {
   size_t local_cnt = 0;
   size_t num_query = state->query_nodes.size();
   state->recvNodes.reserve(state->recvNodes.size() + num_query);
-  for (auto iter=state->query_nodes.begin(); iter != state->query_nodes.end();) {
-    node_id node = *iter;
+  // local nodes come from the store, remote ones are looked up in the cache as one batch
+  std::vector<node_id, ArenaAllocator<node_id>> remote(state->alloc());
+  remote.reserve(num_query);
+  for (node_id node : state->query_nodes) {
     if (handle_->isLocalNode(node)) {
       state->recvNodes[node] = handle_->getNode(node);
       local_cnt++;
-    } else if (cache_)  {
-      std::lock_guard<std::mutex> lock(cache_mtx_);
-      cache_->lookup(node, state->recvNodes[node]);
+    } else {
+      remote.push_back(node);
     }
-    // create empty slot to avoid write conflict on callback
-    if (state->recvNodes[node]) {
+  }
+  if (trace_) trace_->record(remote.data(), remote.size());
+  std::vector<NodeData, ArenaAllocator<NodeData>> found(remote.size(), NodeData(), state->alloc());
+  // cached nodes may lack some of the columns, those count as misses and keep their place
+  // a sampling query with features also takes the cached features alone, queryRemote then only pulls the sample
+  int need = (columns & kNodeSample) && (columns & kNodeFeature) ? int(kNodeFeature) : columns;
+  auto covers = [need](const NodeData &node) { return coversColumns(node.columns, need); };
+  if (cache_) cache_->lookup(remote.data(), found.data(), remote.size(), covers);
+  // keep the empty slot to avoid write conflict on callback, partial hits stay in query_nodes
+  for (size_t i = 0; i < remote.size(); i++)
+    state->recvNodes[remote[i]] = std::move(found[i]);
+  for (auto iter=state->query_nodes.begin(); iter != state->query_nodes.end();) {
+    const NodeData &node = state->recvNodes[*iter];
+    if (node && coversColumns(node.columns, columns)) {
       iter = state->query_nodes.erase(iter);
     } else {
-      state->recvNodes[node] = makeNodeData();
       iter++;
     }
   }
   // Handle profile data
-  cache_mtx_.lock();
   total_cnt_ += num_query;
   nonlocal_cnt_ += num_query - local_cnt;
   cache_miss_cnt_ += state->query_nodes.size();
-  cache_mtx_.unlock();
 }
 
 } // namespace ps
@@ -1,34 +1,160 @@
 #include "graph/sampler.h"
 #include "graph/graph_handle.h"
+#include "common/gather.h"
+#include "ps/internal/utils.h"
 
 namespace ps {
 
-sampleState makeSampleState(SamplerType type) {
-  sampleState state;
-  if (type == SamplerType::kRandomWalk) {
-    state = std::make_shared<_randomWalkState>();
-  } else if (type == SamplerType::kGraphSage) {
-    state = std::make_shared<_graphSageState>();
-  } else {
-    state = std::make_shared<_sampleState>();
+namespace {
+
+// copy features of all nodes into the minibatch, in the iteration order of the pack
+void gatherFeature(const NodePack &node_pack, size_t f_len, size_t i_len, GraphMiniBatch &graph) {
+  static const size_t nthread = GetEnv("GRAPHMIX_GATHER_THREAD", 1);
+  size_t n = node_pack.size();
+  std::vector<const void*> f_rows, i_rows;
+  f_rows.reserve(n);
+  i_rows.reserve(n);
+  for (auto &node : node_pack) {
+    CHECK_EQ(node.second.f_feat.size(), f_len);
+    CHECK_EQ(node.second.i_feat.size(), i_len);
+    f_rows.push_back(node.second.f_feat.data());
+    i_rows.push_back(node.second.i_feat.data());
   }
-  state->type = type;
-  return state;
+  // every row is overwritten, skip the zero initialization
+  graph.f_feat = SArray<graph_float>(new graph_float[n * f_len], n * f_len, true);
+  graph.i_feat = SArray<graph_int>(new graph_int[n * i_len], n * i_len, true);
+  gather::gatherRows(f_rows.data(), n, f_len * sizeof(graph_float), graph.f_feat.data(), nthread);
+  gather::gatherRows(i_rows.data(), n, i_len * sizeof(graph_int), graph.i_feat.data(), nthread);
+}
+
+} // namespace
+
+void _sampleState::clear() {
+  // containers are replaced before the arena is reset, the old elements are destructed in place
+  query_nodes = NodeSet(alloc());
+  recvNodes = NodePack(0, NodePack::hasher(), NodePack::key_equal(), alloc());
+  wait_num = 0;
+  arena.reset();
+}
+
+void _randomWalkState::clear() {
+  frontier = NodeSet(alloc());
+  rw_round = 0;
+  walkers.clear();
+  visited.clear();
+  walk_done = false;
+  _sampleState::clear();
+}
+
+void _graphSageState::clear() {
+  frontier = NodeSet(alloc());
+  core_node = NodeSet(alloc());
+  edges.clear();
+  expand_round = 0;
+  _sampleState::clear();
+}
+
+sampleState SampleStatePool::get() {
+  std::unique_ptr<_sampleState> state;
+  {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (!free_.empty()) {
+      state = std::move(free_.back());
+      free_.pop_back();
+    }
+  }
+  if (!state) {
+    if (type_ == SamplerType::kRandomWalk) {
+      state = std::make_unique<_randomWalkState>();
+    } else if (type_ == SamplerType::kGraphSage) {
+      state = std::make_unique<_graphSageState>();
+    } else {
+      state = std::make_unique<_sampleState>();
+    }
+    state->type = type_;
+    state->tag = tag_;
+    state->owner = owner_;
+  }
+  auto self = shared_from_this();
+  return sampleState(state.release(), [self](_sampleState *ptr) { self->release(ptr); });
+}
+
+void SampleStatePool::release(_sampleState *state) {
+  state->clear();
+  std::lock_guard<std::mutex> lock(mtx_);
+  free_.emplace_back(state);
 }
 
 BaseSampler::BaseSampler(GraphHandle *handle, SamplerTag tag)
   : handle_(handle->shared_from_this()), tag_(tag) {}
 
 void BaseSampler::sample_start() {
-  auto func = [this] () {
-    while (!killed_) {
-      sampleState state = handle_->getRemote()->getSampleState(type(), tag());
-      CHECK(state->type == type());
-      CHECK(state->tag == tag());
-      sample_once(std::move(state));
-    }
-  };
-  thread_ = std::thread(func);
+  pool_ = std::make_shared<SampleStatePool>(this, type(), tag());
+  wake();
+}
+
+void BaseSampler::wake() {
+  if (killed_) return;
+  notified_ = true;
+  if (!scheduled_.exchange(true))
+    handle_->executor()->Submit([this]() { step(); });
+}
+
+void BaseSampler::queryRemote(sampleState state, int columns, int fanout) {
+  waiting_++;
+  handle_->getRemote()->queryRemote(std::move(state), columns, fanout);
+}
+
+void BaseSampler::walkRemote(sampleState state) {
+  waiting_++;
+  handle_->getRemote()->walkRemote(std::move(state));
+}
+
+void BaseSampler::resume(sampleState state) {
+  ready_.Push(std::move(state));
+  // join() can return and the sampler be destroyed once the lock is released, so finish under it
+  std::lock_guard<std::mutex> lock(join_mtx_);
+  waiting_--;
+  if (killed_) join_cv_.notify_all();
+  else wake();
+}
+
+void BaseSampler::join() {
+  std::unique_lock<std::mutex> lock(join_mtx_);
+  join_cv_.wait(lock, [this] { return !scheduled_ && waiting_ == 0; });
+}
+
+bool BaseSampler::nextState(sampleState *state) {
+  if (ready_.TryPop(state)) return true;
+  if (!handle_->acquireCredit(tag())) return false;
+  *state = pool_->get();
+  return true;
+}
+
+void BaseSampler::step() {
+  notified_ = false;
+  sampleState state;
+  bool progress = !killed_ && nextState(&state);
+  if (progress) {
+    CHECK(state->type == type());
+    CHECK(state->tag == tag());
+    sample_once(std::move(state));
+  }
+  // keep the executor busy with this sampler while it has work
+  if (progress && !killed_) {
+    handle_->executor()->Submit([this]() { step(); });
+    return;
+  }
+  // join() can return and the sampler be destroyed once the lock is released, so finish under it
+  std::lock_guard<std::mutex> lock(join_mtx_);
+  scheduled_ = false;
+  if (killed_) {
+    join_cv_.notify_all();
+    return;
+  }
+  // a wake() may have come after nextState failed, the step queued here keeps join() waiting
+  if (notified_ && !scheduled_.exchange(true))
+    handle_->executor()->Submit([this]() { step(); });
 }
 
 // construct a set of node into a graph
@@ -38,35 +164,27 @@ GraphMiniBatch BaseSampler::construct(const NodePack &node_pack) {
   graph.tag = tag();
   graph.type = static_cast<int>(type());
   size_t n = node_pack.size();
-  graph.f_feat.resize(n * handle_->fLen());
-  graph.i_feat.resize(n * handle_->iLen());
+  gatherFeature(node_pack, handle_->fLen(), handle_->iLen(), graph);
   graph.csr_i.resize(n + 1);
-  std::unordered_map<node_id, node_id> idx_map;
+  reindex_.reset(n);
+  for (auto &node : node_pack) reindex_.insert(node.first);
   for (auto &node : node_pack) {
-    int idx = idx_map.size();
-    idx_map[node.first] = idx;
-  }
-  for (auto &node : node_pack) {
-    node_id idx = idx_map[node.first];
-    for (node_id neighbor : node.second->edge) {
-      if (idx_map.count(neighbor)) {
-        graph.csr_j.push_back(idx_map[neighbor]);
-      }
+    node_id idx = reindex_.find(node.first);
+    for (node_id neighbor : node.second.edge) {
+      node_id nidx = reindex_.find(neighbor);
+      if (nidx >= 0) graph.csr_j.push_back(nidx);
     }
     graph.csr_i[idx + 1] = graph.csr_j.size();
-    std::copy(node.second->f_feat.begin(), node.second->f_feat.end(), &graph.f_feat[idx * handle_->fLen()]);
-    std::copy(node.second->i_feat.begin(), node.second->i_feat.end(), &graph.i_feat[idx * handle_->iLen()]);
   }
   return graph;
 }
 
 void LocalNodeSampler::sample_once(sampleState state) {
-  NodePack node_pack;
   auto nodes = rd_.unique(batch_size_, handle_->nNodes());
   for (node_id node: nodes) {
-    node_pack.emplace(node + handle_->offset(), handle_->getNode(node + handle_->offset()));
+    state->recvNodes.emplace(node + handle_->offset(), handle_->getNode(node + handle_->offset()));
   }
-  handle_->push(construct(node_pack), tag());
+  handle_->push(construct(state->recvNodes), tag());
 }
 
 void GlobalNodeSampler::sample_once(sampleState state) {
@@ -74,7 +192,7 @@ void GlobalNodeSampler::sample_once(sampleState state) {
     // new samples
     auto nodes = rd_.unique(batch_size_, handle_->numGraphNodes());
     for (auto node : nodes) state->query_nodes.emplace(node);
-    handle_->getRemote()->queryRemote(std::move(state));
+    queryRemote(std::move(state));
   } else {
     handle_->push(construct(state->recvNodes), tag());
   }
@@ -82,6 +200,10 @@ void GlobalNodeSampler::sample_once(sampleState state) {
 
 void RandomWalkSampler::sample_once(sampleState state_base) {
   auto state = std::static_pointer_cast<_randomWalkState>(state_base);
+  if (pushdown_) {
+    walk_once(std::move(state));
+    return;
+  }
   if (state->rw_round == rw_length_) {
     // if ready
     handle_->push(construct(state->recvNodes), tag());
@@ -96,20 +218,64 @@ void RandomWalkSampler::sample_once(sampleState state_base) {
     }
   }
   // select neighbor for frontier
-  auto new_frontier = decltype(state->frontier)();
+  NodeSet new_frontier(state->alloc());
   state->query_nodes.clear();
   for (node_id node : state->frontier) {
-    size_t num_neighbor = state->recvNodes[node]->edge.size();
+    size_t num_neighbor = state->recvNodes[node].edge.size();
     if (num_neighbor == 0) continue;
     auto rd = rd_.randInt(num_neighbor);
-    node_id nxt_node = state->recvNodes[node]->edge[rd];
+    node_id nxt_node = state->recvNodes[node].edge[rd];
     if (!state->recvNodes.count(nxt_node))
       state->query_nodes.emplace(nxt_node);
     new_frontier.emplace(nxt_node);
   }
   state->frontier = std::move(new_frontier);
   state->rw_round++;
-  handle_->getRemote()->queryRemote(std::move(state));
+  queryRemote(std::move(state));
+}
+
+void RandomWalkSampler::walk_once(std::shared_ptr<_randomWalkState> state) {
+  if (state->walk_done) {
+    // all walks finished and the nodes are pulled
+    handle_->push(construct(state->recvNodes), tag());
+    return;
+  }
+  if (state->recvNodes.empty()) {
+    // Start a new sample
+    auto nodes = rd_.unique(rw_head_, handle_->nNodes());
+    for (node_id node: nodes) {
+      state->recvNodes.emplace(node + handle_->offset(), handle_->getNode(node + handle_->offset()));
+      state->walkers.emplace_back(node + handle_->offset(), rw_length_);
+    }
+  }
+  // walk on the local partition until walkers step out
+  bool remote = false;
+  for (auto &walker : state->walkers) {
+    while (walker.second > 0 && handle_->isLocalNode(walker.first)) {
+      auto edge = handle_->getNode(walker.first).edge;
+      if (edge.empty()) {
+        walker.second = 0;
+        break;
+      }
+      walker.first = edge[rd_.randInt(edge.size())];
+      walker.second--;
+      if (handle_->isLocalNode(walker.first))
+        state->recvNodes.emplace(walker.first, handle_->getNode(walker.first));
+      else
+        state->visited.push_back(walker.first);
+    }
+    if (walker.second > 0) remote = true;
+  }
+  if (remote) {
+    walkRemote(std::move(state));
+    return;
+  }
+  // remote nodes are pulled once all walks are finished, query_nodes stays empty until then
+  for (node_id node : state->visited)
+    if (!state->recvNodes.count(node)) state->query_nodes.emplace(node);
+  state->visited.clear();
+  state->walk_done = true;
+  queryRemote(std::move(state));
 }
 
 GraphMiniBatch GraphSageSampler::SageConstruct(sampleState state_base) {
@@ -117,25 +283,37 @@ GraphMiniBatch GraphSageSampler::SageConstruct(sampleState state_base) {
   GraphMiniBatch graph;
   graph.tag = tag();
   graph.type = static_cast<int>(type());
-  size_t n = state->recvNodes.size();
-  graph.f_feat.resize(n * handle_->fLen());
-  graph.i_feat.resize(n * handle_->iLen());
-  std::unordered_map<node_id, node_id> idx_map;
-  for (auto &node : state->recvNodes) {
-    int idx = idx_map.size();
-    idx_map[node.first] = idx;
-  }
-  for (auto &node : state->recvNodes) {
-    node_id idx = idx_map[node.first];
-    std::copy(node.second->f_feat.begin(), node.second->f_feat.end(), &graph.f_feat[idx * handle_->fLen()]);
-    std::copy(node.second->i_feat.begin(), node.second->i_feat.end(), &graph.i_feat[idx * handle_->iLen()]);
-  }
-  graph.csr_i.reserve(state->coo.size());
-  graph.csr_j.reserve(state->coo.size());
-  for (auto &pair : state->coo) {
-    graph.csr_i.push_back(idx_map[pair.first]);
-    graph.csr_j.push_back(idx_map[pair.second]);
+  gatherFeature(state->recvNodes, handle_->fLen(), handle_->iLen(), graph);
+  reindex_.reset(state->recvNodes.size());
+  for (auto &node : state->recvNodes) reindex_.insert(node.first);
+  // sampled edges are undirected, bucket both directions by source then dedup each row
+  size_t n = state->recvNodes.size(), num_edges = 2 * state->edges.size();
+  graph.csr_i.resize(n + 1);
+  for (auto &edge : state->edges) {
+    node_id u = reindex_.find(edge.first), v = reindex_.find(edge.second);
+    CHECK(u >= 0 && v >= 0) << "Sampled node not received";
+    graph.csr_i[u + 1]++;
+    graph.csr_i[v + 1]++;
+  }
+  for (size_t i = 0; i < n; i++) graph.csr_i[i + 1] += graph.csr_i[i];
+  edge_buf_.resize(num_edges);
+  std::vector<node_id> pos(graph.csr_i.begin(), graph.csr_i.end() - 1);
+  for (auto &edge : state->edges) {
+    node_id u = reindex_.find(edge.first), v = reindex_.find(edge.second);
+    edge_buf_[pos[u]++] = v;
+    edge_buf_[pos[v]++] = u;
+  }
+  graph.csr_j = SArray<node_id>(new node_id[num_edges], num_edges, true);
+  size_t nnz = 0;
+  for (size_t i = 0; i < n; i++) {
+    auto begin = edge_buf_.begin() + graph.csr_i[i], end = edge_buf_.begin() + graph.csr_i[i + 1];
+    std::sort(begin, end);
+    end = std::unique(begin, end);
+    graph.csr_i[i] = nnz;
+    nnz = std::copy(begin, end, graph.csr_j.begin() + nnz) - graph.csr_j.begin();
   }
+  graph.csr_i[n] = nnz;
+  graph.csr_j.resize(nnz);
   return graph;
 }
 
@@ -167,16 +345,18 @@ void GraphSageSampler::sample_once(sampleState state_base) {
   }
 
   // select neighbor for frontier
-  auto new_frontier = decltype(state->frontier)();
+  NodeSet new_frontier(state->alloc());
   state->query_nodes.clear();
   for (node_id node : state->frontier) {
-    for (size_t i = 0; i < width_; i++) {
-      size_t num_neighbor = state->recvNodes[node]->edge.size();
+    const NodeData &data = state->recvNodes[node];
+    // remote nodes pulled with kNodeSample come with width_ neighbors sampled by their owner
+    bool sampled = data.columns & kNodeSample;
+    size_t num_pick = sampled ? data.edge.size() : width_;
+    for (size_t i = 0; i < num_pick; i++) {
+      size_t num_neighbor = data.edge.size();
       if (num_neighbor == 0) continue;
-      auto rd = rd_.randInt(num_neighbor);
-      node_id nxt_node = state->recvNodes[node]->edge[rd];
-      state->coo.emplace(nxt_node, node);
-      state->coo.emplace(node, nxt_node);
+      node_id nxt_node = sampled ? data.edge[i] : data.edge[rd_.randInt(num_neighbor)];
+      state->edges.emplace_back(nxt_node, node);
       if (!state->recvNodes.count(nxt_node))
         state->query_nodes.emplace(nxt_node);
       new_frontier.emplace(nxt_node);
@@ -186,7 +366,12 @@ void GraphSageSampler::sample_once(sampleState state_base) {
   if (state->expand_round == 0) state->core_node = std::move(state->frontier);
   state->frontier = std::move(new_frontier);
   state->expand_round++;
-  handle_->getRemote()->queryRemote(std::move(state));
+  // the last hop is not expanded, SageConstruct only needs its features
+  // other hops only need width_ neighbors, the owner server samples them unless construct needs the adjacency
+  if (subgraph_) queryRemote(std::move(state));
+  else if (state->expand_round == depth_) queryRemote(std::move(state), kNodeFeature);
+  else if (pushdown_) queryRemote(std::move(state), kNodeFeature | kNodeSample, width_);
+  else queryRemote(std::move(state));
 }
 
 void GraphSageSampler::try_build_index(ssize_t index) {
@@ -198,7 +383,7 @@ void GraphSageSampler::try_build_index(ssize_t index) {
   } else {
     CHECK(index >= 0 && size_t(index) < handle_->iLen());
     for (node_id i = handle_->offset(); i < handle_->offset() + handle_->nNodes(); i++) {
-      if (handle_->getNode(i)->i_feat[index] == 1) {
+      if (handle_->getNode(i).i_feat[index] == 1) {
         train_index.push_back(i);
       }
     }
@@ -0,0 +1,428 @@
+/**
+ *  TCP transport on io_uring, used by UringVan and benchmark/van_bench
+ */
+#ifndef PS_URING_TRANSPORT_H_
+#define PS_URING_TRANSPORT_H_
+#include <liburing.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include <chrono>
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+#include "common/sarray.h"
+
+namespace ps {
+
+/*
+  Wire format, per connection:
+    hello : int32 node id of the connecting side, Meta::kEmpty if it is not assigned yet
+    then each message : UringHeader | uint64 size of each data frame | meta | data frames
+  Frames are the ones of Message, meta is packed by PackMeta as for ZMQ
+*/
+struct UringHeader {
+  uint32_t meta_size;
+  uint32_t num_data;
+};
+
+/*
+  UringMessage:
+    A message as read from the wire, sender is the hello of its connection
+*/
+struct UringMessage {
+  int sender;
+  SArray<char> meta;
+  std::vector<SArray<char>> data;
+  size_t bytes;
+};
+
+// blocking send of the whole buffer, used for the hello and when a uring send is short
+inline bool sendAll(int fd, const char *buf, size_t len) {
+  while (len > 0) {
+    ssize_t n = ::send(fd, buf, len, MSG_NOSIGNAL);
+    if (n < 0 && errno == EINTR) continue;
+    if (n <= 0) return false;
+    buf += n;
+    len -= n;
+  }
+  return true;
+}
+
+/**
+ * \brief connect to host:port, retry until timeout_sec since the peer may not listen yet
+ * \return the socket, -1 on failure
+ */
+inline int connectTcp(const std::string &host, int port, int timeout_sec = 60) {
+  struct addrinfo hints, *res = nullptr;
+  memset(&hints, 0, sizeof(hints));
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  if (getaddrinfo(host.c_str(), std::to_string(port).c_str(), &hints, &res) != 0) return -1;
+  int fd = -1;
+  auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(timeout_sec);
+  while (true) {
+    fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (fd == -1) break;
+    if (connect(fd, res->ai_addr, res->ai_addrlen) == 0) break;
+    close(fd);
+    fd = -1;
+    if (std::chrono::steady_clock::now() > deadline) break;
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  }
+  freeaddrinfo(res);
+  if (fd != -1) {
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  }
+  return fd;
+}
+
+/**
+ * \brief listen on 0.0.0.0:port
+ * \return the socket, -1 if the port is taken
+ */
+inline int listenTcp(int port) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  if (fd == -1) return -1;
+  int one = 1;
+  setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+  struct sockaddr_in addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0 || listen(fd, 1024) != 0) {
+    close(fd);
+    return -1;
+  }
+  return fd;
+}
+
+/*
+  UringSender:
+    One outgoing connection with its own ring, used by one thread at a time
+    A message is one batch of linked sends submitted at once, small pieces are copied into a staging
+    buffer and frames of at least zc_bytes go out with SEND_ZC straight from their SArray.
+    The SArray is held until the kernel notifies that it is done with the pages
+    A short send breaks the link, the rest of the message is then written with plain send()
+*/
+class UringSender {
+ public:
+  UringSender(int fd, int hello, size_t zc_bytes) : fd_(fd), zc_bytes_(zc_bytes) {
+    CHECK_EQ(io_uring_queue_init(kEntries, &ring_, 0), 0) << "io_uring_queue_init failed";
+    struct io_uring_probe *probe = io_uring_get_probe_ring(&ring_);
+    if (!probe || !io_uring_opcode_supported(probe, IORING_OP_SEND_ZC)) zc_bytes_ = SIZE_MAX;
+    if (probe) io_uring_free_probe(probe);
+    CHECK(sendAll(fd_, reinterpret_cast<char*>(&hello), sizeof(hello))) << strerror(errno);
+  }
+  ~UringSender() {
+    // the pages of zero-copy sends must not be freed while the kernel uses them
+    while (!zc_pending_.empty()) reap(true);
+    io_uring_queue_exit(&ring_);
+    close(fd_);
+  }
+  UringSender(const UringSender&) = delete;
+  UringSender& operator=(const UringSender&) = delete;
+
+  /**
+   * \brief send a message
+   * \return the number of bytes sent, -1 if failed
+   */
+  int send(const char *meta, int meta_size, const std::vector<SArray<char>> &data) {
+    while (reap(false)) {}
+    UringHeader header;
+    header.meta_size = meta_size;
+    header.num_data = data.size();
+    staging_.clear();
+    segments_.clear();
+    stage(reinterpret_cast<char*>(&header), sizeof(header));
+    for (auto &d : data) {
+      uint64_t size = d.size();
+      stage(reinterpret_cast<char*>(&size), sizeof(size));
+    }
+    stage(meta, meta_size);
+    for (auto &d : data) {
+      if (d.size() >= zc_bytes_) {
+        segments_.push_back(Segment{d.data(), 0, d.size(), d});
+      } else {
+        stage(d.data(), d.size());
+      }
+    }
+    size_t total = 0;
+    for (auto &seg : segments_) total += seg.len;
+    CHECK_LE(segments_.size(), kEntries) << "too many frames in one message";
+    // one batch, linked so that the kernel keeps the order on the stream
+    uint64_t base = next_tag_;
+    next_tag_ += segments_.size();
+    for (size_t i = 0; i < segments_.size(); i++) {
+      auto &seg = segments_[i];
+      struct io_uring_sqe *sqe = io_uring_get_sqe(&ring_);
+      CHECK(sqe);
+      if (seg.ptr) {
+        io_uring_prep_send_zc(sqe, fd_, seg.ptr, seg.len, MSG_NOSIGNAL | MSG_WAITALL, 0);
+      } else {
+        io_uring_prep_send(sqe, fd_, staging_.data() + seg.offset, seg.len, MSG_NOSIGNAL | MSG_WAITALL);
+      }
+      if (i + 1 < segments_.size()) io_uring_sqe_set_flags(sqe, IOSQE_IO_LINK);
+      io_uring_sqe_set_data64(sqe, base + i);
+    }
+    io_uring_submit(&ring_);
+    results_.assign(segments_.size(), 0);
+    size_t done = 0;
+    while (done < segments_.size()) {
+      struct io_uring_cqe *cqe;
+      int ret = io_uring_wait_cqe(&ring_, &cqe);
+      if (ret == -EINTR) continue;
+      CHECK_EQ(ret, 0) << strerror(-ret);
+      uint64_t tag = io_uring_cqe_get_data64(cqe);
+      if (cqe->flags & IORING_CQE_F_NOTIF) {
+        zc_pending_.erase(tag);
+      } else {
+        size_t i = tag - base;
+        results_[i] = cqe->res;
+        // a notification follows, the kernel still reads the pages
+        if (cqe->flags & IORING_CQE_F_MORE) zc_pending_[tag] = segments_[i].hold;
+        done++;
+      }
+      io_uring_cqe_seen(&ring_, cqe);
+    }
+    // finish a broken chain in order
+    for (size_t i = 0; i < segments_.size(); i++) {
+      auto &seg = segments_[i];
+      size_t sent = results_[i] > 0 ? results_[i] : 0;
+      if (sent == seg.len) continue;
+      if (results_[i] < 0 && results_[i] != -ECANCELED && results_[i] != -EAGAIN) {
+        LOG(WARNING) << "uring send failed: " << strerror(-results_[i]);
+        return -1;
+      }
+      const char *ptr = seg.ptr ? seg.ptr : staging_.data() + seg.offset;
+      if (!sendAll(fd_, ptr + sent, seg.len - sent)) return -1;
+    }
+    return total;
+  }
+
+ private:
+  struct Segment {
+    const char *ptr; // null for a piece of staging_
+    size_t offset, len;
+    SArray<char> hold;
+  };
+
+  // append to staging_, merged with the previous segment if it is also staged
+  void stage(const char *buf, size_t len) {
+    if (segments_.empty() || segments_.back().ptr) segments_.push_back(Segment{nullptr, staging_.size(), 0, {}});
+    staging_.insert(staging_.end(), buf, buf + len);
+    segments_.back().len += len;
+  }
+
+  // handle zero-copy notifications, return whether one was handled
+  bool reap(bool wait) {
+    struct io_uring_cqe *cqe;
+    int ret = wait ? io_uring_wait_cqe(&ring_, &cqe) : io_uring_peek_cqe(&ring_, &cqe);
+    if (ret != 0) return false;
+    if (cqe->flags & IORING_CQE_F_NOTIF) zc_pending_.erase(io_uring_cqe_get_data64(cqe));
+    io_uring_cqe_seen(&ring_, cqe);
+    return true;
+  }
+
+  static const unsigned kEntries = 256;
+  int fd_;
+  size_t zc_bytes_;
+  struct io_uring ring_;
+  uint64_t next_tag_ = 0;
+  std::vector<char> staging_;
+  std::vector<Segment> segments_;
+  std::vector<int> results_;
+  std::unordered_map<uint64_t, SArray<char>> zc_pending_;
+};
+
+/*
+  UringReceiver:
+    All incoming connections of a node on one ring, driven by the thread calling recv()
+    The listening socket is armed with a multishot accept and every connection with a multishot recv
+    that picks buffers from a provided buffer ring, the bytes are parsed into messages and each buffer
+    is handed back to the ring right away
+*/
+class UringReceiver {
+ public:
+  explicit UringReceiver(int listen_fd) : listen_fd_(listen_fd) {
+    CHECK_EQ(io_uring_queue_init(kEntries, &ring_, 0), 0) << "io_uring_queue_init failed";
+    int ret = 0;
+    buf_ring_ = io_uring_setup_buf_ring(&ring_, kBufCount, kBufGroup, 0, &ret);
+    CHECK(buf_ring_) << "io_uring_setup_buf_ring failed: " << strerror(-ret);
+    pool_.reset(new char[kBufCount * kBufSize]);
+    for (unsigned i = 0; i < kBufCount; i++)
+      io_uring_buf_ring_add(buf_ring_, pool_.get() + i * kBufSize, kBufSize, i, io_uring_buf_ring_mask(kBufCount), i);
+    io_uring_buf_ring_advance(buf_ring_, kBufCount);
+    armAccept();
+  }
+  ~UringReceiver() {
+    // the ring holds the sockets until its teardown finishes in the background, shutdown frees the port now
+    for (auto &it : conns_) {
+      shutdown(it.first, SHUT_RDWR);
+      close(it.first);
+    }
+    shutdown(listen_fd_, SHUT_RDWR);
+    close(listen_fd_);
+    io_uring_free_buf_ring(&ring_, buf_ring_, kBufCount, kBufGroup);
+    io_uring_queue_exit(&ring_);
+  }
+  UringReceiver(const UringReceiver&) = delete;
+  UringReceiver& operator=(const UringReceiver&) = delete;
+
+  // block until a message is complete
+  void recv(UringMessage *msg) {
+    while (ready_.empty()) {
+      io_uring_submit_and_wait(&ring_, 1);
+      struct io_uring_cqe *cqe;
+      unsigned head, count = 0;
+      io_uring_for_each_cqe(&ring_, head, cqe) {
+        handle(cqe);
+        count++;
+      }
+      io_uring_cq_advance(&ring_, count);
+    }
+    // connections armed again while handling
+    if (io_uring_sq_ready(&ring_)) io_uring_submit(&ring_);
+    *msg = std::move(ready_.front());
+    ready_.pop_front();
+  }
+
+ private:
+  enum Stage { kHello, kHeader, kSizes, kMeta, kData };
+  struct Conn {
+    Stage stage = kHello;
+    char *dst; // where the bytes of the current stage go
+    size_t want; // bytes left in the current stage
+    int hello;
+    UringHeader header;
+    std::vector<uint64_t> sizes;
+    UringMessage msg;
+  };
+  enum Op : uint64_t { kAccept = 1, kRecv = 2 };
+
+  void armAccept() {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&ring_);
+    CHECK(sqe);
+    io_uring_prep_multishot_accept(sqe, listen_fd_, nullptr, nullptr, 0);
+    io_uring_sqe_set_data64(sqe, kAccept << 32);
+  }
+
+  void armRecv(int fd) {
+    struct io_uring_sqe *sqe = io_uring_get_sqe(&ring_);
+    CHECK(sqe);
+    io_uring_prep_recv_multishot(sqe, fd, nullptr, 0, 0);
+    sqe->flags |= IOSQE_BUFFER_SELECT;
+    sqe->buf_group = kBufGroup;
+    io_uring_sqe_set_data64(sqe, kRecv << 32 | uint32_t(fd));
+  }
+
+  void handle(struct io_uring_cqe *cqe) {
+    uint64_t data = io_uring_cqe_get_data64(cqe);
+    int fd = static_cast<int>(data & 0xffffffff);
+    bool more = cqe->flags & IORING_CQE_F_MORE;
+    if (data >> 32 == kAccept) {
+      CHECK_NE(cqe->res, -EINVAL) << "the uring van needs Linux 6.0 or newer";
+      if (cqe->res >= 0) {
+        int one = 1;
+        setsockopt(cqe->res, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        Conn &conn = conns_[cqe->res];
+        conn.dst = reinterpret_cast<char*>(&conn.hello);
+        conn.want = sizeof(conn.hello);
+        armRecv(cqe->res);
+      }
+      if (!more) armAccept();
+      return;
+    }
+    auto it = conns_.find(fd);
+    if (it == conns_.end()) return;
+    if (cqe->res > 0) {
+      unsigned bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+      consume(it->second, pool_.get() + bid * kBufSize, cqe->res);
+      io_uring_buf_ring_add(buf_ring_, pool_.get() + bid * kBufSize, kBufSize, bid, io_uring_buf_ring_mask(kBufCount), 0);
+      io_uring_buf_ring_advance(buf_ring_, 1);
+      if (!more) armRecv(fd);
+    } else if (cqe->res == -ENOBUFS) {
+      // the buffers are handed back as they are parsed, just try again
+      armRecv(fd);
+    } else {
+      // closed by the peer
+      if (cqe->res < 0) LOG(WARNING) << "uring recv failed: " << strerror(-cqe->res);
+      close(fd);
+      conns_.erase(it);
+    }
+  }
+
+  void consume(Conn &conn, const char *buf, size_t len) {
+    while (len > 0) {
+      size_t n = std::min(len, conn.want);
+      memcpy(conn.dst, buf, n);
+      conn.dst += n;
+      conn.want -= n;
+      buf += n;
+      len -= n;
+      while (conn.want == 0) next(conn);
+    }
+  }
+
+  // the current stage is complete, set up the next one
+  void next(Conn &conn) {
+    switch (conn.stage) {
+      case kHello:
+        expect(conn, kHeader, reinterpret_cast<char*>(&conn.header), sizeof(conn.header));
+        break;
+      case kHeader:
+        conn.sizes.resize(conn.header.num_data);
+        expect(conn, kSizes, reinterpret_cast<char*>(conn.sizes.data()), conn.sizes.size() * sizeof(uint64_t));
+        break;
+      case kSizes:
+        conn.msg = UringMessage();
+        conn.msg.sender = conn.hello;
+        conn.msg.meta.resize(conn.header.meta_size);
+        conn.msg.bytes = sizeof(UringHeader) + conn.sizes.size() * sizeof(uint64_t) + conn.header.meta_size;
+        expect(conn, kMeta, conn.msg.meta.data(), conn.msg.meta.size());
+        break;
+      case kMeta:
+      case kData:
+        if (conn.msg.data.size() == conn.sizes.size()) {
+          ready_.push_back(std::move(conn.msg));
+          expect(conn, kHeader, reinterpret_cast<char*>(&conn.header), sizeof(conn.header));
+        } else {
+          size_t size = conn.sizes[conn.msg.data.size()];
+          conn.msg.data.push_back(SArray<char>(size));
+          conn.msg.bytes += size;
+          expect(conn, kData, conn.msg.data.back().data(), size);
+        }
+        break;
+    }
+  }
+
+  void expect(Conn &conn, Stage stage, char *dst, size_t want) {
+    conn.stage = stage;
+    conn.dst = dst;
+    conn.want = want;
+  }
+
+  static const unsigned kEntries = 1024;
+  static const unsigned kBufCount = 256;
+  static const unsigned kBufSize = 64 << 10;
+  static const int kBufGroup = 0;
+  int listen_fd_;
+  struct io_uring ring_;
+  struct io_uring_buf_ring *buf_ring_;
+  std::unique_ptr<char[]> pool_;
+  std::unordered_map<int, Conn> conns_;
+  std::deque<UringMessage> ready_;
+};
+
+}  // namespace ps
+#endif  // PS_URING_TRANSPORT_H_
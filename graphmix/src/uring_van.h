@@ -0,0 +1,134 @@
+/**
+ *  io_uring based Van, raw TCP without ZMQ
+ */
+#ifndef PS_URING_VAN_H_
+#define PS_URING_VAN_H_
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include "ps/internal/van.h"
+#include "./uring_transport.h"
+
+namespace ps {
+
+/**
+ * \brief io_uring based implementation, select it with GRAPHMIX_PS_VAN_TYPE=uring
+ *
+ * every node listens on its port and opens one connection to each node it sends to.
+ * messages keep the frames of \ref Message, see \ref UringHeader. frames of at least
+ * GRAPHMIX_URING_ZC_BYTES bytes are sent with zero-copy. standalone clients are not
+ * supported, they talk ZMQ
+ */
+class UringVan : public Van {
+ public:
+  UringVan() {}
+  virtual ~UringVan() {}
+
+ protected:
+  void Start(int customer_id) override {
+    start_mu_.lock();
+    zc_bytes_ = GetEnv("GRAPHMIX_URING_ZC_BYTES", 32768);
+    start_mu_.unlock();
+    Van::Start(customer_id);
+  }
+
+  void Stop() override {
+    PS_VLOG(1) << my_node_.ShortDebugString() << " is stopping";
+    Van::Stop();
+    {
+      std::lock_guard<std::mutex> lk(senders_mu_);
+      senders_.clear();
+    }
+    receiver_.reset();
+  }
+
+  int Bind(const Node& node, int max_retry) override {
+    int port = node.port;
+    unsigned seed = static_cast<unsigned>(time(NULL) + port);
+    int fd = -1;
+    for (int i = 0; i < max_retry + 1; ++i) {
+      fd = listenTcp(port);
+      if (fd != -1) break;
+      if (i == max_retry) {
+        return -1;
+      } else {
+        port = 10000 + rand_r(&seed) % 40000;
+      }
+    }
+    receiver_.reset(new UringReceiver(fd));
+    return port;
+  }
+
+  void Connect(const Node& node) override {
+    CHECK_NE(node.id, node.kEmpty);
+    CHECK_NE(node.port, node.kEmpty);
+    CHECK(node.hostname.size());
+    int id = node.id;
+    {
+      std::lock_guard<std::mutex> lk(senders_mu_);
+      senders_.erase(id);
+    }
+    // worker doesn't need to connect to the other workers. same for server
+    if ((node.role == my_node_.role) && (node.id != my_node_.id) && node.role == Node::Role::WORKER) {
+      return;
+    }
+    int fd = connectTcp(node.hostname, node.port);
+    CHECK_NE(fd, -1) << "connect to " << node.hostname << ":" << node.port << " failed: " << strerror(errno);
+    auto sender = std::make_shared<Sender>();
+    sender->channel.reset(new UringSender(fd, my_node_.id, zc_bytes_));
+    std::lock_guard<std::mutex> lk(senders_mu_);
+    senders_[id] = sender;
+  }
+
+  int SendMsg(const Message& msg) override {
+    int id = msg.meta.recver;
+    CHECK_NE(id, Meta::kEmpty);
+    std::shared_ptr<Sender> sender;
+    {
+      std::lock_guard<std::mutex> lk(senders_mu_);
+      auto it = senders_.find(id);
+      if (it != senders_.end()) sender = it->second;
+    }
+    if (!sender) {
+      LOG(WARNING) << "there is no socket to node " << id;
+      return -1;
+    }
+    int meta_size; char* meta_buf;
+    PackMeta(msg.meta, &meta_buf, &meta_size);
+    int send_bytes;
+    {
+      std::lock_guard<std::mutex> lk(sender->mu);
+      send_bytes = sender->channel->send(meta_buf, meta_size, msg.data);
+    }
+    delete[] meta_buf;
+    return send_bytes;
+  }
+
+  int RecvMsg(Message* msg) override {
+    UringMessage raw;
+    receiver_->recv(&raw);
+    msg->meta.sender = raw.sender;
+    msg->meta.recver = my_node_.id;
+    UnpackMeta(raw.meta.data(), raw.meta.size(), &(msg->meta));
+    msg->data = std::move(raw.data);
+    return raw.bytes;
+  }
+
+ private:
+  /**
+   * \brief the connection to one node, sends to different nodes run in parallel
+   */
+  struct Sender {
+    std::mutex mu;
+    std::unique_ptr<UringSender> channel;
+  };
+  std::unordered_map<int, std::shared_ptr<Sender>> senders_;
+  std::mutex senders_mu_;
+  /** \brief all incoming connections, only used by the receiving thread */
+  std::unique_ptr<UringReceiver> receiver_;
+  size_t zc_bytes_ = 32768;
+};
+}  // namespace ps
+
+#endif  // PS_URING_VAN_H_
@@ -3,6 +3,7 @@
  */
 
 #include <chrono>
+#include <cstring>
 #include <thread>
 
 #include "ps/base.h"
@@ -17,6 +18,9 @@
 #include "./resender.h"
 #include "./zmq_van.h"
 #include "./p3_van.h"
+#ifdef GRAPHMIX_USE_URING
+#include "./uring_van.h"
+#endif
 
 namespace ps {
 
@@ -34,6 +38,10 @@ Van* Van::Create(const std::string& type) {
 #ifdef DMLC_USE_IBVERBS
 } else if (type == "ibverbs") {
     return new IBVerbsVan();
+#endif
+#ifdef GRAPHMIX_USE_URING
+  } else if (type == "uring") {
+    return new UringVan();
 #endif
   } else {
     LOG(FATAL) << "Unsupported van type: " << type;
@@ -232,6 +240,16 @@ void Van::ProcessDataMsg(Message* msg) {
   obj->Accept(*msg);
 }
 
+void Van::DeliverDataMsg(Message* msg, int recv_bytes) {
+  CHECK(msg->meta.control.empty()) << "control message on a data lane " << msg->DebugString();
+  recv_bytes_ += recv_bytes;
+  if (Postoffice::Get()->verbose() >= 2) {
+    PS_VLOG(2) << msg->DebugString();
+  }
+  if (resender_ && resender_->AddIncomming(*msg)) return;
+  ProcessDataMsg(msg);
+}
+
 void Van::ProcessAddNodeCommand(Message* msg, Meta* nodes,
                                 Meta* recovery_nodes) {
   auto dead_nodes = Postoffice::Get()->GetDeadNodes(heartbeat_timeout_);
@@ -376,7 +394,8 @@ void Van::Stop() {
   receiver_thread_->join(); // wait for receiver to join
   init_stage = 0;
   if (!is_scheduler_) heartbeat_thread_->join();
-  if (resender_) delete resender_;
+  delete resender_;
+  resender_ = nullptr;
   ready_ = false;
   connected_nodes_.clear();
   shared_node_mapping_.clear();
@@ -470,8 +489,46 @@ void PackMetaPB(const Meta& meta, PBMeta* pb) {
   }
 }
 
+/*
+  BinaryMeta:
+    Fixed layout of the meta of data messages, copied in and out without protobuf
+    A serialized PBMeta never starts with a zero byte, so tag tells the two apart
+    Both ends are the same build, the layout is not meant to cross versions or endianness
+*/
+struct BinaryMeta {
+  uint8_t tag;
+  uint8_t request;
+  uint16_t psftype;
+  int32_t app_id;
+  int32_t customer_id;
+  int32_t timestamp;
+  int32_t sender;
+  int32_t recver;
+  int32_t priority;
+  int32_t shm_mask;
+};
+static_assert(sizeof(BinaryMeta) == 32, "BinaryMeta must not have padding");
+static const uint8_t kBinaryMetaTag = 0;
+
 void PackMeta(const Meta& meta, char** meta_buf, int* buf_size) {
-  // convert into protobuf
+  if (meta.control.empty()) {
+    BinaryMeta bin;
+    bin.tag = kBinaryMetaTag;
+    bin.request = meta.request;
+    bin.psftype = static_cast<uint16_t>(meta.psftype);
+    bin.app_id = meta.app_id;
+    bin.customer_id = meta.customer_id;
+    bin.timestamp = meta.timestamp;
+    bin.sender = meta.sender;
+    bin.recver = meta.recver;
+    bin.priority = meta.priority;
+    bin.shm_mask = meta.shm_mask;
+    *buf_size = sizeof(bin);
+    *meta_buf = new char[sizeof(bin)];
+    memcpy(*meta_buf, &bin, sizeof(bin));
+    return;
+  }
+  // control messages are rare, convert into protobuf
   PBMeta pb;
   if (meta.app_id != Meta::kEmpty) pb.set_app_id(meta.app_id);
   if (meta.timestamp != Meta::kEmpty) pb.set_timestamp(meta.timestamp);
@@ -479,6 +536,7 @@ void PackMeta(const Meta& meta, char** meta_buf, int* buf_size) {
   pb.set_priority(meta.priority);
   pb.set_customer_id(meta.customer_id);
   pb.set_psftype(meta.psftype);
+  if (meta.shm_mask) pb.set_shm_mask(meta.shm_mask);
   if (!meta.control.empty()) {
     auto ctrl = pb.mutable_control();
     ctrl->set_cmd(meta.control.cmd);
@@ -506,6 +564,22 @@ void PackMeta(const Meta& meta, char** meta_buf, int* buf_size) {
 }
 
 void UnpackMeta(const char* meta_buf, int buf_size, Meta* meta) {
+  if (buf_size == sizeof(BinaryMeta) && meta_buf[0] == kBinaryMetaTag) {
+    BinaryMeta bin;
+    memcpy(&bin, meta_buf, sizeof(bin));
+    meta->app_id = bin.app_id;
+    meta->timestamp = bin.timestamp;
+    meta->request = bin.request;
+    meta->priority = bin.priority;
+    meta->customer_id = bin.customer_id;
+    meta->psftype = static_cast<PsfType>(bin.psftype);
+    meta->shm_mask = bin.shm_mask;
+    // the van knows the peer from its connection, the packed ids only fill what it left empty
+    if (meta->sender == Meta::kEmpty) meta->sender = bin.sender;
+    if (meta->recver == Meta::kEmpty) meta->recver = bin.recver;
+    meta->control.cmd = Control::EMPTY;
+    return;
+  }
   // to protobuf
   PBMeta pb;
   CHECK(pb.ParseFromArray(meta_buf, buf_size))
@@ -518,6 +592,7 @@ void UnpackMeta(const char* meta_buf, int buf_size, Meta* meta) {
   meta->priority = pb.priority();
   meta->customer_id = pb.customer_id();
   meta->psftype = static_cast<PsfType>(pb.psftype());
+  meta->shm_mask = pb.shm_mask();
 
   if (pb.has_control()) {
     const auto& ctrl = pb.control();
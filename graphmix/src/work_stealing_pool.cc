@@ -0,0 +1,79 @@
+#include "common/work_stealing_pool.h"
+
+namespace {
+// the pool and worker index of the current thread
+thread_local WorkStealingPool *current_pool = nullptr;
+thread_local size_t current_id = 0;
+} // namespace
+
+WorkStealingPool::WorkStealingPool(size_t thread_num) {
+  if (thread_num == 0) thread_num = 1;
+  for (size_t i = 0; i < thread_num; i++)
+    queues_.emplace_back(new WorkQueue());
+  for (size_t i = 0; i < thread_num; i++)
+    threads_.emplace_back(&WorkStealingPool::workerLoop, this, i);
+}
+
+WorkStealingPool::~WorkStealingPool() {
+  {
+    std::lock_guard<std::mutex> lock(sleep_mtx_);
+    terminate_ = true;
+  }
+  cond_.notify_all();
+  for (auto &thread : threads_) thread.join();
+}
+
+void WorkStealingPool::Submit(std::function<void()> task) {
+  size_t id = current_pool == this ? current_id : next_++ % queues_.size();
+  // counted before the push, a worker popping the task at once must not take pending_ below 0
+  pending_++;
+  {
+    std::lock_guard<std::mutex> lock(queues_[id]->mtx);
+    queues_[id]->tasks.push_back(std::move(task));
+  }
+  // pairs with the check in workerLoop, a sleeper either sees pending_ or gets notified
+  if (sleepers_.load() > 0) {
+    std::lock_guard<std::mutex> lock(sleep_mtx_);
+    cond_.notify_one();
+  }
+}
+
+bool WorkStealingPool::popLocal(size_t id, std::function<void()> *task) {
+  auto &queue = *queues_[id];
+  std::lock_guard<std::mutex> lock(queue.mtx);
+  if (queue.tasks.empty()) return false;
+  *task = std::move(queue.tasks.back());
+  queue.tasks.pop_back();
+  return true;
+}
+
+bool WorkStealingPool::steal(size_t id, std::function<void()> *task) {
+  for (size_t i = 1; i < queues_.size(); i++) {
+    auto &queue = *queues_[(id + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(queue.mtx);
+    if (queue.tasks.empty()) continue;
+    *task = std::move(queue.tasks.front());
+    queue.tasks.pop_front();
+    return true;
+  }
+  return false;
+}
+
+void WorkStealingPool::workerLoop(size_t id) {
+  current_pool = this;
+  current_id = id;
+  std::function<void()> task;
+  while (true) {
+    if (popLocal(id, &task) || steal(id, &task)) {
+      pending_--;
+      task();
+      task = nullptr;
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(sleep_mtx_);
+    sleepers_++;
+    cond_.wait(lock, [this] { return terminate_ || pending_.load() > 0; });
+    sleepers_--;
+    if (terminate_ && pending_.load() == 0) return;
+  }
+}
@@ -6,8 +6,15 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <zmq.h>
+#include <algorithm>
+#include <memory>
+#include <mutex>
 #include <string>
+#include <thread>
 #include <unordered_map>
+#include <utility>
+#include <vector>
+#include "ps/internal/shm_ring.h"
 #include "ps/internal/van.h"
 #if _MSC_VER
 #define rand_r(x) rand()
@@ -48,24 +55,37 @@ class ZMQVan : public Van {
     else if (Postoffice::Get()->is_server())
       zmq_threads = GetEnv("GRAPHMIX_SERVER_ZMQ_THREAD", 8);
     zmq_ctx_set(context_, ZMQ_IO_THREADS, zmq_threads);
+    // servers may get standalone clients on this host
+    int shm_mb = GetEnv("GRAPHMIX_SHM_MB", 64);
+    if (!shm_ring_ && shm_mb > 0 && (GetEnv("GRAPHMIX_LOCAL", 0) || Postoffice::Get()->is_server())) {
+      shm_ring_.reset(ShmRing::create(static_cast<size_t>(shm_mb) << 20));
+    }
+    shm_min_bytes_ = GetEnv("GRAPHMIX_SHM_MIN_BYTES", 65536);
     start_mu_.unlock();
     Van::Start(customer_id);
   }
 
   void Stop() override {
     PS_VLOG(1) << my_node_.ShortDebugString() << " is stopping";
+    // the lane threads deliver to the customers and the resender, stop them before
+    // Van::Stop tears those down. each of them closes its own sockets
+    for (auto stop : lane_stops_) CHECK_EQ(zmq_send(stop, "", 0, 0), 0) << zmq_strerror(errno);
+    for (auto& thread : lane_threads_) thread.join();
+    lane_threads_.clear();
+    for (auto stop : lane_stops_) CHECK_EQ(zmq_close(stop), 0);
+    lane_stops_.clear();
     Van::Stop();
     // close sockets
     int linger = 0;
     int rc = zmq_setsockopt(receiver_, ZMQ_LINGER, &linger, sizeof(linger));
     CHECK(rc == 0 || errno == ETERM);
     CHECK_EQ(zmq_close(receiver_), 0);
-    for (auto& it : senders_) {
-      int rc = zmq_setsockopt(it.second, ZMQ_LINGER, &linger, sizeof(linger));
-      CHECK(rc == 0 || errno == ETERM);
-      CHECK_EQ(zmq_close(it.second), 0);
+    {
+      std::lock_guard<std::mutex> lk(senders_mu_);
+      for (auto& it : senders_) closeSender(it.second.get(), linger);
+      senders_.clear();
     }
-    senders_.clear();
+    shm_ring_.reset();
     zmq_ctx_destroy(context_);
     context_ = nullptr;
   }
@@ -74,15 +94,16 @@ class ZMQVan : public Van {
     receiver_ = zmq_socket(context_, ZMQ_ROUTER);
     CHECK(receiver_ != NULL)
         << "create receiver socket failed: " << zmq_strerror(errno);
-    int local = GetEnv("GRAPHMIX_LOCAL", 0);
-    std::string hostname = node.hostname.empty() ? "*" : node.hostname;
-    hostname = "0.0.0.0";
-    std::string addr = local ? "ipc:///tmp/" : "tcp://" + hostname + ":";
+    std::vector<void*> lanes(recvLanes(node.role) - 1);
+    for (auto& lane : lanes) {
+      lane = zmq_socket(context_, ZMQ_ROUTER);
+      CHECK(lane != NULL)
+          << "create receiver socket failed: " << zmq_strerror(errno);
+    }
     int port = node.port;
     unsigned seed = static_cast<unsigned>(time(NULL) + port);
     for (int i = 0; i < max_retry + 1; ++i) {
-      auto address = addr + std::to_string(port);
-      if (zmq_bind(receiver_, address.c_str()) == 0) break;
+      if (bindLanes(lanes, port)) break;
       if (i == max_retry) {
         port = -1;
       } else {
@@ -90,20 +111,38 @@ class ZMQVan : public Van {
         //port = 3014 + rand_r(&seed) % 3;
       }
     }
+    for (size_t k = 0; k < lanes.size(); k++) {
+      if (port == -1) {
+        zmq_close(lanes[k]);
+        continue;
+      }
+      // a PAIR of inproc sockets per lane, Stop signals the lane thread through it
+      std::string addr = "inproc://lane-stop-" + std::to_string(k + 1);
+      void *wait = zmq_socket(context_, ZMQ_PAIR);
+      CHECK_EQ(zmq_bind(wait, addr.c_str()), 0) << zmq_strerror(errno);
+      void *stop = zmq_socket(context_, ZMQ_PAIR);
+      CHECK_EQ(zmq_connect(stop, addr.c_str()), 0) << zmq_strerror(errno);
+      lane_stops_.push_back(stop);
+      lane_threads_.emplace_back(&ZMQVan::LaneReceiving, this, lanes[k], wait);
+    }
     return port;
   }
 
   void connectBack(int port) {
+    std::lock_guard<std::mutex> lk(senders_mu_);
     auto it = senders_.find(port);
     if (it != senders_.end()) {
       return;
     }
-    void *sender = zmq_socket(context_, ZMQ_DEALER);
-    CHECK(sender != NULL) << zmq_strerror(errno);
+    void *socket = zmq_socket(context_, ZMQ_DEALER);
+    CHECK(socket != NULL) << zmq_strerror(errno);
     std::string addr = "ipc:///tmp/" + std::to_string(port);
-    if (zmq_connect(sender, addr.c_str()) != 0) {
+    if (zmq_connect(socket, addr.c_str()) != 0) {
       LOG(FATAL) <<  "connect to " + addr + " failed: " + zmq_strerror(errno);
     }
+    auto sender = std::make_shared<Sender>();
+    sender->socket = socket;
+    sender->shm = shm_ring_ != nullptr;
     senders_[port] = sender;
   }
 
@@ -115,12 +154,7 @@ class ZMQVan : public Van {
       rmsg.meta.control.cmd = Control::TERMINATE;
       SendMsg(rmsg);
       // Remove sender socket
-      int linger = -1;
-      void* sender = senders_[msg.meta.sender];
-      int rc = zmq_setsockopt(sender, ZMQ_LINGER, &linger, sizeof(linger));
-      CHECK(rc == 0 || errno == ETERM);
-      CHECK_EQ(zmq_close(sender), 0);
-      senders_.erase(msg.meta.sender);
+      removeSender(msg.meta.sender, -1);
       PS_VLOG(0) << "Server " << Postoffice::Get()->my_rank() << " Worker Leave from port " << msg.meta.sender;
     } else if (msg.meta.control.cmd == Control::ARRIVE) {
       connectBack(msg.meta.sender);
@@ -140,41 +174,35 @@ class ZMQVan : public Van {
     CHECK_NE(node.port, node.kEmpty);
     CHECK(node.hostname.size());
     int id = node.id;
-    auto it = senders_.find(id);
-    if (it != senders_.end()) {
-      zmq_close(it->second);
-    }
     // worker doesn't need to connect to the other workers. same for server
     if ((node.role == my_node_.role) && (node.id != my_node_.id) && node.role == Node::Role::WORKER) {
+      removeSender(id, -1);
       return;
     }
-    void *sender = zmq_socket(context_, ZMQ_DEALER);
-    CHECK(sender != NULL)
-        << zmq_strerror(errno)
-        << ". it often can be solved by \"sudo ulimit -n 65536\""
-        << " or edit /etc/security/limits.conf";
+    auto sender = std::make_shared<Sender>();
+    sender->socket = connectLane(node, 0);
+    sender->shm = shm_ring_ && GetEnv("GRAPHMIX_LOCAL", 0);
+    // data messages go to one lane picked by my rank, so that the peers of a node
+    // are spread over its lanes and the messages from one peer stay in order
     if (my_node_.id != Node::kEmpty) {
-      std::string my_id = "ps" + std::to_string(my_node_.id);
-      zmq_setsockopt(sender, ZMQ_IDENTITY, my_id.data(), my_id.size());
+      int lane = dataLane(node.role);
+      if (lane) sender->data_socket = connectLane(node, lane);
     }
-    // connect
-    std::string addr = "tcp://" + node.hostname + ":" + std::to_string(node.port);
-    if (GetEnv("GRAPHMIX_LOCAL", 0)) {
-      addr = "ipc:///tmp/" + std::to_string(node.port);
+    // swap the new sender in before closing the old one, so that a concurrent SendMsg to this
+    // node always finds a sender, it picks up the new one when the old socket is closed under it
+    {
+      std::lock_guard<std::mutex> lk(senders_mu_);
+      senders_[id].swap(sender);
     }
-    if (zmq_connect(sender, addr.c_str()) != 0) {
-      LOG(FATAL) <<  "connect to " + addr + " failed: " + zmq_strerror(errno);
-    }
-    senders_[id] = sender;
+    if (sender) closeSender(sender.get(), -1);
   }
 
   int SendMsg(const Message& msg) override {
-    std::lock_guard<std::mutex> lk(mu_);
-    // find the socket
     int id = msg.meta.recver;
     CHECK_NE(id, Meta::kEmpty);
-    auto it = senders_.find(id);
-    if (it == senders_.end()) {
+    // find the socket
+    std::shared_ptr<Sender> sender = findSender(id);
+    if (!sender) {
       if (id >= 10000) {
         return 0;
       } else {
@@ -182,12 +210,45 @@ class ZMQVan : public Van {
         return -1;
       }
     }
-    void *socket = it->second;
-    // send meta
+    // large frames to a node on this host are copied to shared memory
+    int n = msg.data.size();
+    int shm_mask = 0;
+    std::vector<ShmFrame> shm_frames;
+    if (sender->shm) {
+      shm_frames.resize(n);
+      for (int i = 0; i < n && i < 31; ++i) {
+        if (msg.data[i].size() >= shm_min_bytes_ && shm_ring_->write(msg.data[i], &shm_frames[i]))
+          shm_mask |= 1 << i;
+      }
+    }
     int meta_size; char* meta_buf;
-    PackMeta(msg.meta, &meta_buf, &meta_size);
+    if (shm_mask) {
+      Meta meta = msg.meta;
+      meta.shm_mask = shm_mask;
+      PackMeta(meta, &meta_buf, &meta_size);
+    } else {
+      PackMeta(msg.meta, &meta_buf, &meta_size);
+    }
+    // only the sender to this node is locked while sending
+    while (true) {
+      sender->mu.lock();
+      if (sender->socket) break;
+      // closed by a reconnect, look the new one up
+      sender->mu.unlock();
+      sender = findSender(id);
+      if (!sender) {
+        delete[] meta_buf;
+        for (int i = 0; i < n; ++i) {
+          if (shm_mask >> i & 1) shm_ring_->discard(shm_frames[i]);
+        }
+        return id >= 10000 ? 0 : -1;
+      }
+    }
+    std::lock_guard<std::mutex> lk(sender->mu, std::adopt_lock);
+    void *socket = sender->socket;
+    if (msg.meta.control.empty() && sender->data_socket) socket = sender->data_socket;
+    // send meta
     int tag = ZMQ_SNDMORE;
-    int n = msg.data.size();
     if (n == 0) tag = 0;
     zmq_msg_t meta_msg;
     zmq_msg_init_data(&meta_msg, meta_buf, meta_size, FreeData, NULL);
@@ -201,9 +262,16 @@ class ZMQVan : public Van {
     // send data
     for (int i = 0; i < n; ++i) {
       zmq_msg_t data_msg;
-      SArray<char>* data = new SArray<char>(msg.data[i]);
-      int data_size = data->size();
-      zmq_msg_init_data(&data_msg, data->data(), data->size(), FreeData, data);
+      int data_size;
+      if (shm_mask >> i & 1) {
+        data_size = sizeof(ShmFrame);
+        zmq_msg_init_size(&data_msg, data_size);
+        memcpy(zmq_msg_data(&data_msg), &shm_frames[i], data_size);
+      } else {
+        SArray<char>* data = new SArray<char>(msg.data[i]);
+        data_size = data->size();
+        zmq_msg_init_data(&data_msg, data->data(), data->size(), FreeData, data);
+      }
       if (i == n - 1) tag = 0;
       while (true) {
         if (zmq_msg_send(&data_msg, socket, tag) == data_size) break;
@@ -220,19 +288,28 @@ class ZMQVan : public Van {
   }
 
   int RecvMsg(Message* msg) override {
+    return RecvMsg(receiver_, msg);
+  }
+
+  int RecvMsg(void* socket, Message* msg) {
     msg->data.clear();
     size_t recv_bytes = 0;
     for (int i = 0; ; ++i) {
       zmq_msg_t* zmsg = new zmq_msg_t;
       CHECK(zmq_msg_init(zmsg) == 0) << zmq_strerror(errno);
       while (true) {
-        if (zmq_msg_recv(zmsg, receiver_, 0) != -1) break;
+        if (zmq_msg_recv(zmsg, socket, 0) != -1) break;
         if (errno == EINTR) {
           std::cout << "interrupted";
           continue;
         }
-        LOG(WARNING) << "failed to receive message. errno: "
-                     << errno << " " << zmq_strerror(errno);
+        // the context is shut down when the van stops
+        if (errno != ETERM) {
+          LOG(WARNING) << "failed to receive message. errno: "
+                       << errno << " " << zmq_strerror(errno);
+        }
+        zmq_msg_close(zmsg);
+        delete zmsg;
         return -1;
       }
       char* buf = CHECK_NOTNULL((char *)zmq_msg_data(zmsg));
@@ -252,7 +329,14 @@ class ZMQVan : public Van {
         zmq_msg_close(zmsg);
         bool more = zmq_msg_more(zmsg);
         delete zmsg;
-        handleWorkerCommand(*msg);
+        if (socket == receiver_) handleWorkerCommand(*msg);
+        if (!more) break;
+      } else if (msg->meta.shm_mask >> (i - 2) & 1) {
+        // the frame stays in the shared memory of the sender
+        msg->data.push_back(shm_reader_.wrap(buf, size));
+        bool more = zmq_msg_more(zmsg);
+        zmq_msg_close(zmsg);
+        delete zmsg;
         if (!more) break;
       } else {
         // zero-copy
@@ -270,7 +354,144 @@ class ZMQVan : public Van {
     return recv_bytes;
   }
 
+  /**
+   * \brief thread function of an extra receive lane, data messages are handed
+   * to their customer directly without going through \ref Receiving
+   */
+  void LaneReceiving(void* socket, void* stop) {
+    zmq_pollitem_t items[] = {{socket, 0, ZMQ_POLLIN, 0}, {stop, 0, ZMQ_POLLIN, 0}};
+    while (true) {
+      if (zmq_poll(items, 2, -1) == -1) {
+        if (errno == EINTR) continue;
+        break;
+      }
+      if (items[1].revents & ZMQ_POLLIN) break;
+      Message msg;
+      int recv_bytes = RecvMsg(socket, &msg);
+      if (recv_bytes == -1) break;
+      DeliverDataMsg(&msg, recv_bytes);
+    }
+    int linger = 0;
+    int rc = zmq_setsockopt(socket, ZMQ_LINGER, &linger, sizeof(linger));
+    CHECK(rc == 0 || errno == ETERM);
+    CHECK_EQ(zmq_close(socket), 0);
+    CHECK_EQ(zmq_close(stop), 0);
+  }
+
  private:
+  /**
+   * \brief the sockets to one node, sends to different nodes run in parallel
+   */
+  struct Sender {
+    std::mutex mu;
+    /** \brief lane 0 of the node, for control messages */
+    void *socket = nullptr;
+    /** \brief the lane my data messages go to, null if it is lane 0 */
+    void *data_socket = nullptr;
+    /** \brief whether the node is on this host and large frames go through shm_ring_ */
+    bool shm = false;
+  };
+
+  /**
+   * \brief number of receive lanes of a node, lane 0 also takes the control
+   * messages. every node must see the same values
+   */
+  static int recvLanes(Node::Role role) {
+    if (role == Node::SERVER) return std::max(GetEnv("GRAPHMIX_SERVER_RECV_LANE", 4), 1);
+    if (role == Node::WORKER) return std::max(GetEnv("GRAPHMIX_WORKER_RECV_LANE", 1), 1);
+    return 1;
+  }
+
+  /**
+   * \brief the lane of a node with the given role my data messages go to. lane 0 is left
+   * to control messages when there are more lanes. peers are numbered workers first,
+   * then servers, so that both roles are spread evenly
+   */
+  int dataLane(Node::Role role) {
+    int lanes = recvLanes(role);
+    if (lanes == 1) return 0;
+    int peer = Postoffice::IDtoRank(my_node_.id);
+    if (my_node_.role == Node::SERVER) peer += Postoffice::Get()->num_workers();
+    return 1 + peer % (lanes - 1);
+  }
+
+  /**
+   * \brief address of a receive lane, lanes on tcp are kLanePortStride ports
+   * apart so that they don't take the ports of servers started on port + 1, ...
+   */
+  static std::string laneAddress(const std::string& hostname, int port, int lane) {
+    if (GetEnv("GRAPHMIX_LOCAL", 0)) {
+      std::string addr = "ipc:///tmp/" + std::to_string(port);
+      return lane ? addr + "." + std::to_string(lane) : addr;
+    }
+    return "tcp://" + hostname + ":" + std::to_string(port + lane * kLanePortStride);
+  }
+
+  // bind receiver_ and the lanes, nothing is left bound on failure
+  bool bindLanes(const std::vector<void*>& lanes, int port) {
+    std::string hostname = "0.0.0.0";
+    std::vector<std::pair<void*, std::string>> bound;
+    bool ok = true;
+    for (size_t i = 0; i <= lanes.size() && ok; ++i) {
+      void *socket = i ? lanes[i - 1] : receiver_;
+      auto address = laneAddress(hostname, port, i);
+      ok = zmq_bind(socket, address.c_str()) == 0;
+      if (ok) bound.emplace_back(socket, address);
+    }
+    if (!ok) {
+      for (auto& it : bound) zmq_unbind(it.first, it.second.c_str());
+    }
+    return ok;
+  }
+
+  void* connectLane(const Node& node, int lane) {
+    void *sender = zmq_socket(context_, ZMQ_DEALER);
+    CHECK(sender != NULL)
+        << zmq_strerror(errno)
+        << ". it often can be solved by \"sudo ulimit -n 65536\""
+        << " or edit /etc/security/limits.conf";
+    if (my_node_.id != Node::kEmpty) {
+      std::string my_id = "ps" + std::to_string(my_node_.id);
+      zmq_setsockopt(sender, ZMQ_IDENTITY, my_id.data(), my_id.size());
+    }
+    // connect
+    std::string addr = laneAddress(node.hostname, node.port, lane);
+    if (zmq_connect(sender, addr.c_str()) != 0) {
+      LOG(FATAL) <<  "connect to " + addr + " failed: " + zmq_strerror(errno);
+    }
+    return sender;
+  }
+
+  std::shared_ptr<Sender> findSender(int id) {
+    std::lock_guard<std::mutex> lk(senders_mu_);
+    auto it = senders_.find(id);
+    return it == senders_.end() ? nullptr : it->second;
+  }
+
+  void removeSender(int id, int linger) {
+    std::shared_ptr<Sender> sender;
+    {
+      std::lock_guard<std::mutex> lk(senders_mu_);
+      auto it = senders_.find(id);
+      if (it == senders_.end()) return;
+      sender = std::move(it->second);
+      senders_.erase(it);
+    }
+    closeSender(sender.get(), linger);
+  }
+
+  // waits for the message being sent through it
+  void closeSender(Sender* sender, int linger) {
+    std::lock_guard<std::mutex> lk(sender->mu);
+    for (void* socket : {sender->socket, sender->data_socket}) {
+      if (!socket) continue;
+      int rc = zmq_setsockopt(socket, ZMQ_LINGER, &linger, sizeof(linger));
+      CHECK(rc == 0 || errno == ETERM);
+      CHECK_EQ(zmq_close(socket), 0);
+    }
+    sender->socket = sender->data_socket = nullptr;
+  }
+
   /**
    * return the node id given the received identity
    * \return -1 if not find
@@ -293,11 +514,21 @@ class ZMQVan : public Van {
 
   void *context_ = nullptr;
   /**
-   * \brief node_id to the socket for sending data to this node
+   * \brief node_id to the sockets for sending data to this node
    */
-  std::unordered_map<int, void*> senders_;
-  std::mutex mu_;
+  std::unordered_map<int, std::shared_ptr<Sender>> senders_;
+  /** \brief guards senders_ only, a send holds the lock of its Sender */
+  std::mutex senders_mu_;
   void *receiver_ = nullptr;
+  /** \brief the threads receiving on lanes 1, 2, ... */
+  std::vector<std::thread> lane_threads_;
+  /** \brief one inproc PAIR socket per lane thread, a message on it stops the thread */
+  std::vector<void*> lane_stops_;
+  static const int kLanePortStride = 1000;
+  /** \brief large data frames to nodes on this host, null if disabled */
+  std::unique_ptr<ShmRing> shm_ring_;
+  size_t shm_min_bytes_ = 65536;
+  ShmReader shm_reader_;
 };
 }  // namespace ps
 
@@ -13,6 +13,17 @@ envvar = [
 "GRAPHMIX_SERVER_RECV_THREAD",
 "GRAPHMIX_WORKER_ZMQ_THREAD",
 "GRAPHMIX_SERVER_ZMQ_THREAD",
+"GRAPHMIX_WORKER_RECV_LANE",
+"GRAPHMIX_SERVER_RECV_LANE",
+"GRAPHMIX_SHM_MB",
+"GRAPHMIX_SHM_MIN_BYTES",
+"GRAPHMIX_URING_ZC_BYTES",
+"GRAPHMIX_GATHER_THREAD",
+"GRAPHMIX_SAMPLER_THREAD",
+"GRAPHMIX_CACHE_SHARD",
+"GRAPHMIX_CACHE_TRACE",
+"GRAPHMIX_PULL_WINDOW_US",
+"GRAPHMIX_PULL_BATCH_KEYS",
 "GRAPHMIX_SERVER_PORT",
 "GRAPHMIX_PS_VAN_TYPE",
 "GRAPHMIX_NUM_WORKER",
@@ -35,7 +46,7 @@ def start_server(shard, server_init, server_port=None):
     shard.load_graph_shard(_C.rank())
     server = _C.start_server()
     server.init_meta(shard.meta)
-    server.init_data(shard.f_feat, shard.i_feat, shard.edges)
+    shard.init_server(server)
     del shard
     print("GraphMix Server {} : data initialized at {}:{}".format(_C.rank(), _C.ip(), _C.port()))
     _C.barrier_all()
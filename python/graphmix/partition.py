@@ -1,4 +1,5 @@
 import graphmix
+from graphmix.shard import write_binary_shard
 
 import argparse
 import sys, os
@@ -45,15 +46,8 @@ def part_graph(dataset, nparts, output_path,
         part_dict = partition[i]
         part_dir = os.path.join(output_path, "part{}".format(i))
         os.makedirs(part_dir, exist_ok=True)
-        edge_path = os.path.join(part_dir, "graph.npy")
-        float_feature_path = os.path.join(part_dir, "float_feature.npy")
-        int_feature_path = os.path.join(part_dir, "int_feature.npy")
-        with open(edge_path, 'wb') as f:
-            np.save(f, np.vstack(part_dict["edges"]))
-        with open(float_feature_path, 'wb') as f:
-            np.save(f, float_feature[part_dict["orig_index"]])
-        with open(int_feature_path, 'wb') as f:
-            np.save(f, int_feature[part_dict["orig_index"]])
+        write_binary_shard(os.path.join(part_dir, "graph.bin"), part_dict["edges"],
+            float_feature[part_dict["orig_index"]], int_feature[part_dict["orig_index"]], part_dict["offset"])
     print("step3: save partitioned graph, time cost {:.3f}s".format(time.time()-start))
     part_meta = {
         "nodes" : [len(part_dict["orig_index"]) for part_dict in partition],
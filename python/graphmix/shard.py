@@ -1,7 +1,43 @@
 import libc_graphmix as _PS
 
 import numpy as np
-import os, yaml
+import os, yaml, struct
+
+# binary shard format, keep in sync with ShardHeader in graph_store.h
+_shard_magic = b"GMXSHARD"
+_shard_version = 1
+_shard_alignment = 64
+_shard_header = struct.Struct("<8sQQQQQq4Q")
+
+def _align(size):
+    return (size + _shard_alignment - 1) // _shard_alignment * _shard_alignment
+
+def write_binary_shard(file_path, edges, f_feat, i_feat, offset):
+    num_nodes = f_feat.shape[0]
+    assert i_feat.shape[0] == num_nodes
+    u, v = np.asarray(edges[0], dtype=np.int64), np.asarray(edges[1], dtype=np.int64)
+    # build csr, stable sort keeps the original order of neighbors
+    order = np.argsort(u, kind="stable")
+    indptr = np.zeros(num_nodes + 1, dtype=np.uint64)
+    indptr[1:] = np.cumsum(np.bincount(u - offset, minlength=num_nodes))
+    sections = [
+        indptr,
+        v[order],
+        np.ascontiguousarray(f_feat, dtype=np.float32),
+        np.ascontiguousarray(i_feat, dtype=np.int32),
+    ]
+    section_offset = []
+    pos = _align(_shard_header.size)
+    for arr in sections:
+        section_offset.append(pos)
+        pos = _align(pos + arr.nbytes)
+    header = _shard_header.pack(_shard_magic, _shard_version, num_nodes, len(u),
+        f_feat.shape[1], i_feat.shape[1], offset, *section_offset)
+    with open(file_path, 'wb') as f:
+        f.write(header)
+        for pos, arr in zip(section_offset, sections):
+            f.write(b"\0" * (pos - f.tell()))
+            f.write(arr.tobytes())
 
 class Shard():
     def __init__(self, path):
@@ -15,9 +51,20 @@ class Shard():
     def load_graph_shard(self, shard_idx):
         assert shard_idx >= 0
         path = os.path.join(self.path, "part{}".format(shard_idx))
+        # binary shard is mapped by the server directly, nothing to load here
+        self.binary_path = os.path.join(path, "graph.bin")
+        if os.path.exists(self.binary_path):
+            return
+        self.binary_path = None
         with open(os.path.join(path, "graph.npy"), 'rb') as f:
             self.edges = np.load(f)
         with open(os.path.join(path, "float_feature.npy"), 'rb') as f:
             self.f_feat = np.load(f)
         with open(os.path.join(path, "int_feature.npy"), 'rb') as f:
             self.i_feat = np.load(f)
+
+    def init_server(self, server):
+        if self.binary_path:
+            server.init_data_from_file(self.binary_path)
+        else:
+            server.init_data(self.f_feat, self.i_feat, self.edges)
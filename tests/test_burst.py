@@ -18,6 +18,7 @@ def test(args):
     print("CHECK OK")
 
 def server_init(server):
+    server.init_cache(0.3, graphmix.cache.TinyLFU)
     server.add_sampler(graphmix.sampler.GraphSage, batch_size=64, depth=5, width=2)
     server.is_ready()
 
@@ -0,0 +1,48 @@
+import numpy as np
+import argparse
+import graphmix
+
+def test(args):
+    cora_dataset = graphmix.dataset.load_dataset("Cora")
+    comm = graphmix.Client()
+    num_nodes = cora_dataset.graph.num_nodes
+    # partition of each node, by the global id of its server
+    pack = comm.wait(comm.pull_node(np.arange(num_nodes)))
+    offset = np.array(comm.meta["partition"]["offset"])
+    part = {}
+    for i, node in pack.items():
+        part[node.i[-2]] = np.searchsorted(offset, i, side="right") - 1
+    all_edge = set(zip(*cora_dataset.graph.edge_index))
+
+    def check(graph):
+        index = graph.i_feat[:,-2]
+        for f, i in zip(graph.f_feat, graph.i_feat):
+            idx = i[-2]
+            assert np.all(f==cora_dataset.x[idx])
+            assert i[0] == cora_dataset.y[idx]
+        for u,v in zip(graph.edge_index[0], graph.edge_index[1]):
+            assert (index[u], index[v]) in all_edge
+        return len(set(part[idx] for idx in index))
+
+    # walks of 16 steps from 64 heads leave their partition, both with and without pushdown
+    for sampler in [0, 1]:
+        crossed = 0
+        for i in range(20):
+            graph = comm.wait(comm.pull_graph(sampler))
+            graph.convert2coo()
+            if check(graph) > 1:
+                crossed += 1
+        assert crossed > 0
+    print("CHECK OK")
+
+def server_init(server):
+    server.init_cache(0.3, graphmix.cache.LRU)
+    server.add_sampler(graphmix.sampler.RandomWalk, rw_head=64, rw_length=16)
+    server.add_sampler(graphmix.sampler.RandomWalk, rw_head=64, rw_length=16, pushdown=0)
+    server.is_ready()
+
+if __name__ =='__main__':
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--config", default="../config/test_config.yml")
+    args = parser.parse_args()
+    graphmix.launcher(test, args, server_init=server_init)
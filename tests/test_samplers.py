@@ -39,6 +39,8 @@ def server_init(server):
         server.init_cache(0.3, graphmix.cache.LFU)
     elif server.rank() == 2:
         server.init_cache(0.3, graphmix.cache.LRU)
+    elif server.rank() == 3:
+        server.init_cache(0.3, graphmix.cache.Static)
     server.add_sampler(graphmix.sampler.GlobalNode, batch_size=512)
     server.add_sampler(graphmix.sampler.LocalNode, batch_size=512)
     server.add_sampler(graphmix.sampler.RandomWalk, rw_head=256, rw_length=2)